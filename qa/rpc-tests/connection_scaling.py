@@ -0,0 +1,99 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Wagerr developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Benchmark inbound connection scaling of the socket events backends: a node
+# is started with each -socketevents mode, opened loopback connections are
+# held idle against it, and the number it accepted, how long that took, the
+# CPU it burns while they are idle and the RPC latency meanwhile are printed.
+#
+from test_framework import BitcoinTestFramework
+from util import *
+import os
+import resource
+import socket
+import time
+
+MODES = ("select", "epoll")
+
+def process_cpu_seconds(pid):
+    # utime and stime from /proc/<pid>/stat, in clock ticks
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+class ConnectionScalingTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--connections", dest="connections", default=1500, type="int",
+                          help="Number of loopback peers to open against the node")
+        parser.add_option("--idle", dest="idle", default=10, type="int",
+                          help="Seconds to hold the connections idle while measuring")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        # the loopback peers need a descriptor each on this side too
+        soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+        resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+    def wait_for_connections(self, node, count):
+        # the count settles once the node stops accepting (all held, or full)
+        last, stable = -1, 0
+        while stable < 10:
+            current = node.getconnectioncount()
+            stable = stable + 1 if current == last else 0
+            last = current
+            if current >= count:
+                break
+            time.sleep(0.1)
+        return last
+
+    def run_mode(self, mode):
+        node = start_node(0, self.options.tmpdir,
+                          ["-socketevents="+mode, "-maxconnections=%d" % (self.options.connections + 16)])
+        pid = bitcoind_processes[0].pid
+
+        peers = []
+        start = time.time()
+        try:
+            for i in range(self.options.connections):
+                peer = socket.create_connection(("127.0.0.1", p2p_port(0)))
+                peers.append(peer)
+        except socket.error as e:
+            print("%s: opening peer %d failed: %s" % (mode, len(peers), e))
+        held = self.wait_for_connections(node, len(peers))
+        elapsed = time.time() - start
+
+        cpu_start = process_cpu_seconds(pid)
+        time.sleep(self.options.idle)
+        cpu = process_cpu_seconds(pid) - cpu_start
+
+        rpc_start = time.time()
+        for i in range(50):
+            node.getconnectioncount()
+        rpc_latency = (time.time() - rpc_start) / 50
+
+        print("%s: held %d of %d connections, accepted in %.2fs, idle CPU %.1f%%, RPC latency %.2fms" %
+              (mode, held, len(peers), elapsed, 100 * cpu / self.options.idle, 1000 * rpc_latency))
+
+        for peer in peers:
+            peer.close()
+        stop_node(node, 0)
+        return held, len(peers)
+
+    def run_test(self):
+        for mode in MODES:
+            held, opened = self.run_mode(mode)
+            # unlike select(), epoll is not limited by FD_SETSIZE
+            if mode == "epoll":
+                assert_equal(held, opened)
+
+if __name__ == '__main__':
+    ConnectionScalingTest().main()
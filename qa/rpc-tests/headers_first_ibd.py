@@ -0,0 +1,65 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Wagerr developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Benchmark headers-first initial block download: a fresh node syncs the
+# same regtest chain from one stand-in peer, then from all of them, and
+# the time each sync takes is printed.
+#
+from test_framework import BitcoinTestFramework
+from util import *
+import os
+import shutil
+import time
+
+NUM_PEERS = 4
+
+class HeadersFirstIBDTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--blocks", dest="blocks", default=300, type="int",
+                          help="Length of the chain to sync (regtest only mines PoW blocks up to 300)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, NUM_PEERS + 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        for i in range(NUM_PEERS):
+            self.nodes.append(start_node(i, self.options.tmpdir))
+        self.nodes[0].setgenerate(True, self.options.blocks)
+        for i in range(1, NUM_PEERS):
+            connect_nodes(self.nodes[i], 0)
+        sync_blocks(self.nodes)
+
+    def sync_from(self, num_peers):
+        # start the syncing node from an empty chain
+        i = NUM_PEERS
+        datadir = os.path.join(self.options.tmpdir, "node"+str(i), "regtest")
+        if os.path.isdir(datadir):
+            shutil.rmtree(datadir)
+        node = start_node(i, self.options.tmpdir, ["-debug=net"])
+
+        start = time.time()
+        for peer in range(num_peers):
+            connect_nodes(node, peer)
+        while node.getblockcount() < self.options.blocks and time.time() - start < 300:
+            time.sleep(0.05)
+        elapsed = time.time() - start
+
+        assert_equal(node.getblockcount(), self.options.blocks)
+        assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+        stop_node(node, i)
+        return elapsed
+
+    def run_test(self):
+        for num_peers in (1, NUM_PEERS):
+            elapsed = self.sync_from(num_peers)
+            print("IBD of %d blocks from %d peer(s): %.2fs" % (self.options.blocks, num_peers, elapsed))
+
+if __name__ == '__main__':
+    HeadersFirstIBDTest().main()
@@ -37,8 +37,9 @@ bool AccumulatorMap::Load(uint256 nCheckpoint)
     for (auto& denom : zerocoinDenomList) {
         uint32_t nChecksum = ParseChecksum(nCheckpoint, denom);
 
+        //the values of recent checkpoints are held in memory, only fall back to the database for older ones
         CBigNum bnValue;
-        if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnValue)) {
+        if (!GetAccumulatorValueFromChecksum(nChecksum, true, bnValue) && !zerocoinDB->ReadAccumulatorValue(nChecksum, bnValue)) {
             LogPrintf("%s : cannot find checksum %d", __func__, nChecksum);
             return false;
         }
@@ -16,6 +16,28 @@ using namespace libzerocoin;
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
 std::list<uint256> listAccCheckpointsNoDB;
 
+/**
+ * The zerocoin mints of a recently connected block, kept with the outpoints that
+ * BlockToPubcoinList() filters on, so that invalid outpoints are still filtered
+ * at the time the checkpoint is calculated.
+ */
+struct CCachedMintTx
+{
+    uint256 hashTx;
+    std::vector<COutPoint> vPrevouts;
+    std::vector<std::pair<unsigned int, PublicCoin> > vMints;
+};
+
+struct CCachedBlockMints
+{
+    uint256 hashBlock;
+    std::vector<CCachedMintTx> vTxes;
+};
+
+//! mints of the last PUBCOIN_CACHE_DEPTH connected blocks by height, protected by cs_main
+std::map<int, CCachedBlockMints> mapPubcoinCache;
+static const int PUBCOIN_CACHE_DEPTH = 30;
+
 uint32_t ParseChecksum(uint256 nChecksum, CoinDenomination denomination)
 {
     //shift to the beginning bit of this denomination and trim any remaining bits by returning 32 bits only
@@ -98,6 +120,171 @@ bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nChe
     return true;
 }
 
+void CachePubcoins(const CBlock& block, const CBlockIndex* pindex)
+{
+    CCachedBlockMints& cached = mapPubcoinCache[pindex->nHeight];
+    cached.hashBlock = pindex->GetBlockHash();
+    cached.vTxes.clear();
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsZerocoinMint())
+            continue;
+
+        CCachedMintTx cachedTx;
+        cachedTx.hashTx = tx.GetHash();
+        for (const CTxIn& in : tx.vin)
+            cachedTx.vPrevouts.push_back(in.prevout);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            if (!tx.vout[i].scriptPubKey.IsZerocoinMint())
+                continue;
+
+            CValidationState state;
+            PublicCoin pubCoin(Params().Zerocoin_Params());
+            if (!TxOutToPublicCoin(tx.vout[i], pubCoin, state)) {
+                // leave it to the block read in GetBlockPubcoins() to fail
+                mapPubcoinCache.erase(pindex->nHeight);
+                return;
+            }
+            cachedTx.vMints.push_back(make_pair(i, pubCoin));
+        }
+        cached.vTxes.push_back(cachedTx);
+    }
+
+    while (mapPubcoinCache.begin()->first <= pindex->nHeight - PUBCOIN_CACHE_DEPTH)
+        mapPubcoinCache.erase(mapPubcoinCache.begin());
+}
+
+void UncachePubcoins(const CBlockIndex* pindex)
+{
+    mapPubcoinCache.erase(pindex->nHeight);
+}
+
+//Get the mints of a block on the active chain, from the pubcoin cache if it holds this block
+bool GetBlockPubcoins(const CBlockIndex* pindex, list<PublicCoin>& listPubcoins, bool fFilterInvalid)
+{
+    std::map<int, CCachedBlockMints>::const_iterator mi = mapPubcoinCache.find(pindex->nHeight);
+    if (mi == mapPubcoinCache.end() || mi->second.hashBlock != pindex->GetBlockHash()) {
+        CBlock block;
+        if(!ReadBlockFromDisk(block, pindex)) {
+            LogPrint("zero","%s: failed to read block from disk\n", __func__);
+            return false;
+        }
+        return BlockToPubcoinList(block, listPubcoins, fFilterInvalid);
+    }
+
+    // The same filtering as BlockToPubcoinList()
+    for (const CCachedMintTx& tx : mi->second.vTxes) {
+        if (fFilterInvalid) {
+            bool fValid = true;
+            for (const COutPoint& prevout : tx.vPrevouts) {
+                if (!ValidOutPoint(prevout, INT_MAX)) {
+                    fValid = false;
+                    break;
+                }
+            }
+            if (!fValid)
+                continue;
+        }
+
+        unsigned int nOut = 0;
+        for (const std::pair<unsigned int, PublicCoin>& mint : tx.vMints) {
+            if (fFilterInvalid) {
+                for (; nOut <= mint.first; nOut++) {
+                    if (!ValidOutPoint(COutPoint(tx.hashTx, nOut), INT_MAX))
+                        break;
+                }
+                if (nOut <= mint.first)
+                    break;
+            }
+            listPubcoins.emplace_back(mint.second);
+        }
+    }
+
+    return true;
+}
+
+//Sort the mints of a block by denomination, as they are kept in the mint index
+bool BlockToMintIndex(const CBlock& block, std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> >& mapMints)
+{
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsZerocoinMint())
+            continue;
+
+        CZerocoinMintIndexEntry mint;
+        mint.hashTx = tx.GetHash();
+        for (const CTxIn& in : tx.vin)
+            mint.vPrevouts.push_back(in.prevout);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            if (!tx.vout[i].scriptPubKey.IsZerocoinMint())
+                continue;
+
+            CValidationState state;
+            PublicCoin pubCoin(Params().Zerocoin_Params());
+            if (!TxOutToPublicCoin(tx.vout[i], pubCoin, state))
+                return false;
+
+            mint.bnValue = pubCoin.getValue();
+            mint.nOut = i;
+            mapMints[pubCoin.getDenomination()].push_back(mint);
+        }
+    }
+
+    return true;
+}
+
+bool IndexBlockMints(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> > mapMints;
+    if (!BlockToMintIndex(block, mapMints))
+        return false;
+
+    if (mapMints.empty())
+        return true;
+
+    return zerocoinDB->WriteBlockMints(pindex->nHeight, pindex->GetBlockHash(), mapMints);
+}
+
+bool GetIndexedMints(const CBlockIndex* pindex, CoinDenomination denom, std::vector<CZerocoinMintIndexEntry>& vMints)
+{
+    uint256 hashBlock;
+    if (zerocoinDB->ReadBlockMints(denom, pindex->nHeight, hashBlock, vMints) && hashBlock == pindex->GetBlockHash())
+        return true;
+
+    //blocks connected before the index existed, or a stale entry from a reorganized block: index the block now
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex)) {
+        LogPrint("zero","%s: failed to read block from disk\n", __func__);
+        return false;
+    }
+
+    std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> > mapMints;
+    if (!BlockToMintIndex(block, mapMints))
+        return false;
+
+    if (!mapMints.empty() && !zerocoinDB->WriteBlockMints(pindex->nHeight, pindex->GetBlockHash(), mapMints))
+        LogPrint("zero","%s: failed to index mints of block %d\n", __func__, pindex->nHeight);
+
+    vMints.clear();
+    if (mapMints.count(denom))
+        vMints.swap(mapMints.at(denom));
+    return true;
+}
+
+//The same filter on invalid outpoints as BlockToPubcoinList(..., true)
+bool IsValidMintIndexEntry(const CZerocoinMintIndexEntry& mint)
+{
+    for (const COutPoint& prevout : mint.vPrevouts) {
+        if (!ValidOutPoint(prevout, INT_MAX))
+            return false;
+    }
+
+    for (unsigned int i = 0; i <= mint.nOut; i++) {
+        if (!ValidOutPoint(COutPoint(mint.hashTx, i), INT_MAX))
+            return false;
+    }
+
+    return true;
+}
+
 bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint)
 {
     for (auto& denomination : zerocoinDenomList) {
@@ -215,14 +402,8 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint)
         }
 
         //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex)) {
-            LogPrint("zero","%s: failed to read block from disk\n", __func__);
-            return false;
-        }
-
         std::list<PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid)) {
+        if (!GetBlockPubcoins(pindex, listPubcoins, fFilterInvalid)) {
             LogPrint("zero","%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
             return false;
         }
@@ -259,7 +440,9 @@ bool InvalidCheckpointRange(int nHeight)
     return nHeight > Params().Zerocoin_Block_LastGoodCheckpoint() && nHeight < Params().Zerocoin_Block_RecalculateAccumulators();
 }
 
-bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError)
+//Find the block the coin was minted in, the height from which mints are added to its witness, and the
+//accumulator value the witness starts from (0 if there is none)
+static bool GetWitnessStart(const PublicCoin& coin, int& nHeightMintAdded, int& nAccStartHeight, CBigNum& bnAccValue)
 {
     uint256 txid;
     if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid)) {
@@ -274,7 +457,7 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
         return false;
     }
 
-    int nHeightMintAdded= mapBlockIndex[hashBlock]->nHeight;
+    nHeightMintAdded= mapBlockIndex[hashBlock]->nHeight;
     uint256 nCheckpointBeforeMint = 0;
     CBlockIndex* pindex = chainActive[nHeightMintAdded];
     int nChanges = 0;
@@ -300,7 +483,7 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     }
 
     //the height to start accumulating coins to add to witness
-    int nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
+    nAccStartHeight = nHeightMintAdded - (nHeightMintAdded % 10);
 
     //If the checkpoint is from the recalculated checkpoint period, then adjust it
     int nHeight_LastGoodCheckpoint = Params().Zerocoin_Block_LastGoodCheckpoint();
@@ -312,12 +495,94 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     }
 
     //Get the accumulator that is right before the cluster of blocks containing our mint was added to the accumulator
+    if (!GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue))
+        bnAccValue = 0;
+
+    return true;
+}
+
+//The height a witness is built up to when all available coins are added: at least two checkpoints deep
+static int GetWitnessStopHeight()
+{
+    int nChainHeight = chainActive.Height();
+    return nChainHeight - (nChainHeight % 10) - 20;
+}
+
+//Add the mints of the coin's denomination that were published in this block to its witness
+static bool AddBlockMintsToWitness(const CBlockIndex* pindex, const PublicCoin& coin, int nHeightMintAdded, AccumulatorWitness& witness, int& nMintsAdded)
+{
+    if (!pindex->MintedDenomination(coin.getDenomination()))
+        return true;
+
+    //grab mints of this denomination from the mint index
+    std::vector<CZerocoinMintIndexEntry> vMints;
+    if(!GetIndexedMints(pindex, coin.getDenomination(), vMints)) {
+        LogPrintf("%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
+        return false;
+    }
+
+    //add the mints to the witness
+    for (const CZerocoinMintIndexEntry& mint : vMints) {
+        if (!IsValidMintIndexEntry(mint))
+            continue;
+
+        if (pindex->nHeight == nHeightMintAdded && mint.bnValue == coin.getValue())
+            continue;
+
+        witness.addRawValue(mint.bnValue);
+        ++nMintsAdded;
+    }
+
+    return true;
+}
+
+//Whether a saved witness has the same starting point and its last block is still in the active chain
+static bool CanResumeWitness(const CZerocoinWitness& state, const PublicCoin& coin, int nHeightMintAdded, int nAccStartHeight)
+{
+    if (state.IsNull() || state.bnPubcoin != coin.getValue())
+        return false;
+
+    if (state.nHeightMintAdded != nHeightMintAdded || state.nAccStartHeight != nAccStartHeight)
+        return false;
+
+    //a witness with no blocks added yet is kept as of the block before the first one
+    if (state.nHeight < nAccStartHeight - 1 || state.nHeight > chainActive.Height())
+        return false;
+
+    return chainActive[state.nHeight]->GetBlockHash() == state.hashBlock;
+}
+
+static void ResumeWitness(const CZerocoinWitness& state, const PublicCoin& coin, AccumulatorWitness& witness)
+{
+    Accumulator accumulatorWitness(Params().Zerocoin_Params(), coin.getDenomination());
+    accumulatorWitness.setValue(state.bnWitness);
+    witness.resetValue(accumulatorWitness, coin);
+}
+
+static void SaveWitness(CZerocoinWitness& state, const PublicCoin& coin, const AccumulatorWitness& witness, int nHeightMintAdded,
+                        int nAccStartHeight, const CBlockIndex* pindexLast, int nMintsAdded, int nCheckpointsAdded)
+{
+    state.bnPubcoin = coin.getValue();
+    state.nHeightMintAdded = nHeightMintAdded;
+    state.nAccStartHeight = nAccStartHeight;
+    state.nHeight = pindexLast->nHeight;
+    state.hashBlock = pindexLast->GetBlockHash();
+    state.bnWitness = witness.getValue();
+    state.nMintsAdded = nMintsAdded;
+    state.nCheckpointsAdded = nCheckpointsAdded;
+}
+
+bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator, AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, string& strError, CZerocoinWitness* pWitnessState)
+{
+    int nHeightMintAdded = 0;
+    int nAccStartHeight = 0;
     CBigNum bnAccValue = 0;
-    if (GetAccumulatorValueFromDB(nCheckpointBeforeMint, coin.getDenomination(), bnAccValue)) {
-        if (bnAccValue > 0) {
-            accumulator.setValue(bnAccValue);
-            witness.resetValue(accumulator, coin);
-        }
+    if (!GetWitnessStart(coin, nHeightMintAdded, nAccStartHeight, bnAccValue))
+        return false;
+
+    if (bnAccValue > 0) {
+        accumulator.setValue(bnAccValue);
+        witness.resetValue(accumulator, coin);
     }
 
     //security level: this is an important prevention of tracing the coins via timing. Security level represents how many checkpoints
@@ -333,12 +598,22 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     }
 
     //add the pubcoins (zerocoinmints that have been published to the chain) up to the next checksum starting from the block
-    pindex = chainActive[nAccStartHeight];
-    int nChainHeight = chainActive.Height();
-    int nHeightStop = nChainHeight % 10;
-    nHeightStop = nChainHeight - nHeightStop - 20; // at least two checkpoints deep
+    CBlockIndex* pindex = chainActive[nAccStartHeight];
+    int nHeightStop = GetWitnessStopHeight();
     int nCheckpointsAdded = 0;
     nMintsAdded = 0;
+
+    //skip the blocks already in the saved witness, unless this spend would have stopped before reaching its last block
+    if (pWitnessState && CanResumeWitness(*pWitnessState, coin, nHeightMintAdded, nAccStartHeight) && pWitnessState->nHeight < nHeightStop &&
+        (nSecurityLevel == 100 || pWitnessState->nCheckpointsAdded < nSecurityLevel)) {
+        ResumeWitness(*pWitnessState, coin, witness);
+        pindex = chainActive[pWitnessState->nHeight + 1];
+        nMintsAdded = pWitnessState->nMintsAdded;
+        nCheckpointsAdded = pWitnessState->nCheckpointsAdded;
+    }
+
+    CBlockIndex* pindexLast = NULL;
+    int nCheckpointsAddedLast = nCheckpointsAdded;
     while (pindex->nHeight < nHeightStop + 1) {
         if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
             ++nCheckpointsAdded;
@@ -357,36 +632,18 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
         }
 
         // if this block contains mints of the denomination that is being spent, then add them to the witness
-        if (pindex->MintedDenomination(coin.getDenomination())) {
-            //grab mints from this block
-            CBlock block;
-            if(!ReadBlockFromDisk(block, pindex)) {
-                LogPrintf("%s: failed to read block from disk while adding pubcoins to witness\n", __func__);
-                return false;
-            }
-
-            list<PublicCoin> listPubcoins;
-            if(!BlockToPubcoinList(block, listPubcoins, true)) {
-                LogPrintf("%s: failed to get zerocoin mintlist from block %n\n", __func__, pindex->nHeight);
-                return false;
-            }
-
-            //add the mints to the witness
-            for (const PublicCoin pubcoin : listPubcoins) {
-                if (pubcoin.getDenomination() != coin.getDenomination())
-                    continue;
-
-                if (pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
-                    continue;
-
-                witness.addRawValue(pubcoin.getValue());
-                ++nMintsAdded;
-            }
-        }
+        if (!AddBlockMintsToWitness(pindex, coin, nHeightMintAdded, witness, nMintsAdded))
+            return false;
 
+        pindexLast = pindex;
+        nCheckpointsAddedLast = nCheckpointsAdded;
         pindex = chainActive[pindex->nHeight + 1];
     }
 
+    //hand the witness back as of the last block added, so that the next spend can start from there
+    if (pWitnessState && pindexLast && (pindexLast->nHeight > pWitnessState->nHeight || !CanResumeWitness(*pWitnessState, coin, nHeightMintAdded, nAccStartHeight)))
+        SaveWitness(*pWitnessState, coin, witness, nHeightMintAdded, nAccStartHeight, pindexLast, nMintsAdded, nCheckpointsAddedLast);
+
     if (nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
         strError = _(strprintf("Less than %d mints added, unable to create spend", Params().Zerocoin_RequiredAccumulation()).c_str());
         LogPrintf("%s : %s\n", __func__, strError);
@@ -397,10 +654,64 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     int nZerocoinStartHeight = GetZerocoinStartHeight();
     pindex = chainActive[nZerocoinStartHeight];
     while (pindex->nHeight < nAccStartHeight) {
-        nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), coin.getDenomination());
+        nMintsAdded += pindex->GetMintCount(coin.getDenomination());
         pindex = chainActive[pindex->nHeight + 1];
     }
 
     LogPrint("zero","%s : %d mints added to witness\n", __func__, nMintsAdded);
     return true;
+}
+
+bool AdvanceAccumulatorWitness(const PublicCoin& coin, CZerocoinWitness& state, int nHeightStop, int& nBlocksLeft)
+{
+    //every spend adds the blocks before the stop height, whatever its security level, so only those are added here
+    nHeightStop = std::min(nHeightStop, GetWitnessStopHeight());
+
+    //a witness that already reaches the stop height, on the active chain, needs no lookups
+    if (!state.IsNull() && state.bnPubcoin == coin.getValue() && state.nHeight >= nHeightStop - 1 &&
+        state.nHeight <= chainActive.Height() && chainActive[state.nHeight]->GetBlockHash() == state.hashBlock)
+        return true;
+
+    int nHeightMintAdded = 0;
+    int nAccStartHeight = 0;
+    CBigNum bnAccValue = 0;
+    if (!GetWitnessStart(coin, nHeightMintAdded, nAccStartHeight, bnAccValue))
+        return false;
+
+    Accumulator accumulator(Params().Zerocoin_Params(), coin.getDenomination());
+    AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, coin);
+    CBlockIndex* pindex = chainActive[nAccStartHeight];
+    int nMintsAdded = 0;
+    int nCheckpointsAdded = 0;
+    if (CanResumeWitness(state, coin, nHeightMintAdded, nAccStartHeight)) {
+        ResumeWitness(state, coin, witness);
+        pindex = chainActive[state.nHeight + 1];
+        nMintsAdded = state.nMintsAdded;
+        nCheckpointsAdded = state.nCheckpointsAdded;
+    } else {
+        if (bnAccValue > 0) {
+            accumulator.setValue(bnAccValue);
+            witness.resetValue(accumulator, coin);
+        }
+        //keep the starting point, so the next update does not look it up again
+        SaveWitness(state, coin, witness, nHeightMintAdded, nAccStartHeight, chainActive[nAccStartHeight - 1], 0, 0);
+    }
+
+    CBlockIndex* pindexLast = NULL;
+    while (pindex && pindex->nHeight < nHeightStop && nBlocksLeft > 0) {
+        if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
+            ++nCheckpointsAdded;
+
+        if (!AddBlockMintsToWitness(pindex, coin, nHeightMintAdded, witness, nMintsAdded))
+            return false;
+
+        pindexLast = pindex;
+        --nBlocksLeft;
+        pindex = chainActive.Next(pindex);
+    }
+
+    if (pindexLast)
+        SaveWitness(state, coin, witness, nHeightMintAdded, nAccStartHeight, pindexLast, nMintsAdded, nCheckpointsAdded);
+
+    return true;
 }
\ No newline at end of file
@@ -12,7 +12,12 @@
 #include "primitives/zerocoin.h"
 #include "uint256.h"
 
-bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError);
+class CBlock;
+class CBlockIndex;
+class CZerocoinMintIndexEntry;
+
+bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CZerocoinWitness* pWitnessState = NULL);
+bool AdvanceAccumulatorWitness(const libzerocoin::PublicCoin& coin, CZerocoinWitness& state, int nHeightStop, int& nBlocksLeft);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
@@ -22,5 +27,11 @@ bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nChe
 uint32_t ParseChecksum(uint256 nChecksum, libzerocoin::CoinDenomination denomination);
 uint32_t GetChecksum(const CBigNum &bnValue);
 bool InvalidCheckpointRange(int nHeight);
+void CachePubcoins(const CBlock& block, const CBlockIndex* pindex);
+void UncachePubcoins(const CBlockIndex* pindex);
+bool GetBlockPubcoins(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
+bool IndexBlockMints(const CBlock& block, const CBlockIndex* pindex);
+bool GetIndexedMints(const CBlockIndex* pindex, libzerocoin::CoinDenomination denom, std::vector<CZerocoinMintIndexEntry>& vMints);
+bool IsValidMintIndexEntry(const CZerocoinMintIndexEntry& mint);
 
 #endif //WAGERR_ACCUMULATORS_H
@@ -15,6 +15,7 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <stdexcept>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -99,6 +100,8 @@ enum BlockStatus {
     BLOCK_FAILED_VALID = 32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD = 64, //! descends from failed block
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_STAKE_UNCHECKED = 128, //! indexed from its header: kernel and stake modifier are set by ConnectBlock()
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -179,9 +182,11 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+    //! zerocoin specific fields, by position in libzerocoin::zerocoinDenomList: the supply of each
+    //! denomination after this block and the number of mints of each in it. Kept inline as every
+    //! block in the index has them.
+    int64_t nZerocoinSupply[libzerocoin::ZEROCOIN_DENOMINATIONS];
+    uint16_t nMintsInBlock[libzerocoin::ZEROCOIN_DENOMINATIONS];
     
     void SetNull()
     {
@@ -213,10 +218,9 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOMINATIONS; i++)
+            nZerocoinSupply[i] = 0;
+        ClearMints();
     }
 
     CBlockIndex()
@@ -290,18 +294,71 @@ public:
         return block;
     }
 
+    //! position of a denomination in the zerocoin fields, throwing on anything else as std::map::at did
+    static int ZerocoinDenominationIndex(libzerocoin::CoinDenomination denom)
+    {
+        int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (nIndex < 0)
+            throw std::out_of_range(strprintf("CBlockIndex : invalid zerocoin denomination %d", denom));
+        return nIndex;
+    }
+
     int64_t GetZerocoinSupply() const
     {
         int64_t nTotal = 0;
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * mapZerocoinSupply.at(denom);
+            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * GetZerocoinSupply(denom);
         }
         return nTotal;
     }
 
+    int64_t GetZerocoinSupply(libzerocoin::CoinDenomination denom) const
+    {
+        return nZerocoinSupply[ZerocoinDenominationIndex(denom)];
+    }
+
+    void SetZerocoinSupply(libzerocoin::CoinDenomination denom, int64_t nSupply)
+    {
+        nZerocoinSupply[ZerocoinDenominationIndex(denom)] = nSupply;
+    }
+
+    void SetZerocoinSupply(const CBlockIndex& index)
+    {
+        std::copy(index.nZerocoinSupply, index.nZerocoinSupply + libzerocoin::ZEROCOIN_DENOMINATIONS, nZerocoinSupply);
+    }
+
+    int GetMintCount(libzerocoin::CoinDenomination denom) const
+    {
+        return nMintsInBlock[ZerocoinDenominationIndex(denom)];
+    }
+
+    int GetMintCount() const
+    {
+        int nMints = 0;
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOMINATIONS; i++)
+            nMints += nMintsInBlock[i];
+        return nMints;
+    }
+
+    void AddMint(libzerocoin::CoinDenomination denom)
+    {
+        nMintsInBlock[ZerocoinDenominationIndex(denom)]++;
+    }
+
+    void ClearMints()
+    {
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOMINATIONS; i++)
+            nMintsInBlock[i] = 0;
+    }
+
+    void SetMints(const CBlockIndex& index)
+    {
+        std::copy(index.nMintsInBlock, index.nMintsInBlock + libzerocoin::ZEROCOIN_DENOMINATIONS, nMintsInBlock);
+    }
+
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return GetMintCount(denom) > 0;
     }
 
     uint256 GetBlockHash() const
@@ -480,10 +537,55 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
-            READWRITE(mapZerocoinSupply);
-            READWRITE(vMintDenominationsInBlock);
+            SerializeZerocoinFields(s, ser_action, nType, nVersion);
+        }
+
+    }
+
+    //! on disk the zerocoin supply is still a map of denomination to supply, and the mints a vector of their denominations
+    template <typename Stream>
+    void SerializeZerocoinFields(Stream& s, CSerActionSerialize ser_action, int nType, int nVersion)
+    {
+        WriteCompactSize(s, libzerocoin::ZEROCOIN_DENOMINATIONS);
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOMINATIONS; i++) {
+            libzerocoin::CoinDenomination denom = libzerocoin::zerocoinDenomList[i];
+            READWRITE(denom);
+            READWRITE(nZerocoinSupply[i]);
+        }
+
+        WriteCompactSize(s, GetMintCount());
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOMINATIONS; i++) {
+            libzerocoin::CoinDenomination denom = libzerocoin::zerocoinDenomList[i];
+            for (int j = 0; j < nMintsInBlock[i]; j++)
+                READWRITE(denom);
         }
+    }
 
+    template <typename Stream>
+    void SerializeZerocoinFields(Stream& s, CSerActionUnserialize ser_action, int nType, int nVersion)
+    {
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOMINATIONS; i++)
+            nZerocoinSupply[i] = 0;
+        uint64_t nSupplyEntries = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSupplyEntries; i++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            READWRITE(denom);
+            READWRITE(nSupply);
+            int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+            if (nIndex >= 0)
+                nZerocoinSupply[nIndex] = nSupply;
+        }
+
+        ClearMints();
+        uint64_t nMints = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nMints; i++) {
+            libzerocoin::CoinDenomination denom;
+            READWRITE(denom);
+            int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+            if (nIndex >= 0)
+                nMintsInBlock[nIndex]++;
+        }
     }
 
     uint256 GetBlockHash() const
@@ -7,7 +7,11 @@
 
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
+#include "checkqueue.h"
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -17,6 +21,7 @@
 using namespace std;
 
 bool fTestNet = false; //Params().NetworkID() == CBaseChainParams::TESTNET;
+int nStakeThreads = 0;
 
 // Modifier interval: time to elapse before new modifier is computed
 // Set to 3-hour for production network and 20-minute for test network
@@ -241,11 +246,36 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+/** The stake modifier of a block from, and the block the walk to it ended on */
+struct CStakeModifierCacheEntry
+{
+    const CBlockIndex* pindex;
+    uint64_t nStakeModifier;
+    int nStakeModifierHeight;
+    int64_t nStakeModifierTime;
+};
+
+static CCriticalSection cs_stakemodifiercache;
+static std::map<uint256, CStakeModifierCacheEntry> mapStakeModifierCache;
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
-// modifier about a selection interval later than the coin generating the kernel
+// modifier about a selection interval later than the coin generating the kernel.
+// The result is cached per block from. An entry stays valid while the block the walk
+// ended on is in the active chain, since the walk only went through its ancestors.
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
 {
     nStakeModifier = 0;
+    {
+        LOCK(cs_stakemodifiercache);
+        std::map<uint256, CStakeModifierCacheEntry>::const_iterator it = mapStakeModifierCache.find(hashBlockFrom);
+        if (it != mapStakeModifierCache.end() && chainActive.Contains(it->second.pindex)) {
+            nStakeModifier = it->second.nStakeModifier;
+            nStakeModifierHeight = it->second.nStakeModifierHeight;
+            nStakeModifierTime = it->second.nStakeModifierTime;
+            return true;
+        }
+    }
+
     if (!mapBlockIndex.count(hashBlockFrom))
         return error("GetKernelStakeModifier() : block not indexed");
     const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
@@ -270,6 +300,15 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
         }
     }
     nStakeModifier = pindex->nStakeModifier;
+
+    LOCK(cs_stakemodifiercache);
+    if (mapStakeModifierCache.size() >= STAKE_MODIFIER_CACHE_SIZE)
+        mapStakeModifierCache.clear();
+    CStakeModifierCacheEntry& entry = mapStakeModifierCache[hashBlockFrom];
+    entry.pindex = pindex;
+    entry.nStakeModifier = nStakeModifier;
+    entry.nStakeModifierHeight = nStakeModifierHeight;
+    entry.nStakeModifierTime = nStakeModifierTime;
     return true;
 }
 
@@ -280,6 +319,26 @@ uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutInde
     return Hash(ss.begin(), ss.end());
 }
 
+CStakeKernelHasher::CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int prevoutIndex, const uint256& prevoutHash)
+{
+    //laid out the way stakeHash() serializes it
+    unsigned char prefix[8 + 4 + 4 + 32];
+    WriteLE64(prefix, nStakeModifier);
+    WriteLE32(prefix + 8, nTimeBlockFrom);
+    WriteLE32(prefix + 12, prevoutIndex);
+    memcpy(prefix + 16, prevoutHash.begin(), 32);
+    hasher.Write(prefix, sizeof(prefix));
+}
+
+uint256 CStakeKernelHasher::GetHash(unsigned int nTimeTx) const
+{
+    unsigned char time[4];
+    WriteLE32(time, nTimeTx);
+    uint256 hash;
+    CHash256(hasher).Write(time, sizeof(time)).Finalize((unsigned char*)&hash);
+    return hash;
+}
+
 //test hash vs target
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay)
 {
@@ -291,7 +350,7 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 }
 
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockHeader& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
     //assign new variables to make it easier to read
     int64_t nValueIn = txPrev.vout[prevout.n].nValue;
@@ -330,6 +389,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     unsigned int nTryTime = 0;
     unsigned int i;
     int nHeightStart = chainActive.Height();
+    CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevout.n, prevout.hash);
     for (i = 0; i < (nHashDrift); i++) //iterate the hashing
     {
         //new block came in, move on
@@ -338,7 +398,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
 
         //hash this iteration
         nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+        hashProofOfStake = hasher.GetHash(nTryTime);
 
         // if stake hash does not meet the target then continue to next iteration
         if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
@@ -367,41 +427,277 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+bool GetStakeKernelInput(const CBlockHeader& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, CStakeKernelInput& input, bool fPrintProofOfStake)
+{
+    input.prevout = prevout;
+    input.nValueIn = txPrev.vout[prevout.n].nValue;
+    input.nTimeBlockFrom = blockFrom.GetBlockTime();
+
+    if (nTimeTx < input.nTimeBlockFrom) // Transaction timestamp violation
+        return error("GetStakeKernelInput() : nTime violation");
+
+    if (input.nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
+        return error("GetStakeKernelInput() : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d", input.nTimeBlockFrom, nStakeMinAge, nTimeTx);
+
+    if (!GetKernelStakeModifier(blockFrom.GetHash(), input.nStakeModifier, input.nStakeModifierHeight, input.nStakeModifierTime, fPrintProofOfStake)) {
+        LogPrintf("GetStakeKernelInput(): failed to get kernel stake modifier \n");
+        return false;
+    }
+
+    return true;
+}
+
+/** What the checks of one FindStakeKernel() call share: the search parameters and the result */
+class CStakeKernelSearch
+{
+public:
+    uint256 bnTargetPerCoinDay;
+    unsigned int nTimeTx;
+    unsigned int nHashDrift;
+    int64_t nMinTime;
+    int nHeightStart;
+
+    boost::mutex mutex;
+    bool fFound;
+    size_t nIndex;
+    unsigned int nTimeKernel;
+    uint256 hashProofOfStake;
+    int64_t nHashes;
+
+    CStakeKernelSearch() : nTimeTx(0), nHashDrift(0), nMinTime(0), nHeightStart(0), fFound(false), nIndex(0), nTimeKernel(0), nHashes(0) {}
+};
+
+/**
+ * Closure representing the kernel search of one stake input. Returns false once a kernel
+ * has been found or the tip has changed, so that the queue skips the checks still waiting.
+ */
+class CStakeKernelCheck
+{
+private:
+    boost::shared_ptr<CStakeKernelSearch> psearch;
+    boost::shared_ptr<const std::vector<CStakeKernelInput> > pinputs;
+    size_t nIndex;
+
+public:
+    CStakeKernelCheck() : nIndex(0) {}
+    CStakeKernelCheck(const boost::shared_ptr<CStakeKernelSearch>& psearchIn, const boost::shared_ptr<const std::vector<CStakeKernelInput> >& pinputsIn,
+                      size_t nIndexIn) : psearch(psearchIn), pinputs(pinputsIn), nIndex(nIndexIn) {}
+
+    bool operator()();
+
+    void swap(CStakeKernelCheck& check)
+    {
+        psearch.swap(check.psearch);
+        pinputs.swap(check.pinputs);
+        std::swap(nIndex, check.nIndex);
+    }
+};
+
+static CCheckQueue<CStakeKernelCheck> stakekernelcheckqueue(1);
+static CCriticalSection cs_stakekernelcheckqueue;
+
+static CCriticalSection cs_stakekernelhashrate;
+static int64_t nStakeKernelHashRate = 0;
+
+void ThreadStakeKernelCheck()
+{
+    RenameThread("wagerr-stakech");
+    stakekernelcheckqueue.Thread();
+}
+
+bool CStakeKernelCheck::operator()()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(psearch->mutex);
+        if (psearch->fFound)
+            return false;
+    }
+
+    const CStakeKernelInput& input = (*pinputs)[nIndex];
+    CStakeKernelHasher hasher(input.nStakeModifier, input.nTimeBlockFrom, input.prevout.n, input.prevout.hash);
+
+    bool fFound = false;
+    bool fTipChanged = false;
+    unsigned int nTryTime = 0;
+    uint256 hashProofOfStake = 0;
+    int64_t nHashes = 0;
+    for (unsigned int i = 0; i < psearch->nHashDrift; i++) {
+        //new block came in, move on
+        if (chainActive.Height() != psearch->nHeightStart) {
+            fTipChanged = true;
+            break;
+        }
+
+        nTryTime = psearch->nTimeTx + psearch->nHashDrift - i;
+        hashProofOfStake = hasher.GetHash(nTryTime);
+        nHashes++;
+        if (stakeTargetHit(hashProofOfStake, input.nValueIn, psearch->bnTargetPerCoinDay)) {
+            fFound = true;
+            break;
+        }
+    }
+
+    //the times tried only go down, so every later hit of this input would be too old as well
+    if (fFound && nTryTime <= psearch->nMinTime) {
+        LogPrintf("CStakeKernelCheck() : kernel found, but it is too far in the past \n");
+        fFound = false;
+    }
+
+    boost::unique_lock<boost::mutex> lock(psearch->mutex);
+    psearch->nHashes += nHashes;
+    if (fFound && !psearch->fFound) {
+        psearch->fFound = true;
+        psearch->nIndex = nIndex;
+        psearch->nTimeKernel = nTryTime;
+        psearch->hashProofOfStake = hashProofOfStake;
+    }
+    return !psearch->fFound && !fTipChanged;
+}
+
+bool FindStakeKernel(const std::vector<CStakeKernelInput>& vInputs, unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, int64_t nMinTime, size_t& nIndex, unsigned int& nTimeKernel, uint256& hashProofOfStake)
+{
+    boost::shared_ptr<CStakeKernelSearch> psearch(new CStakeKernelSearch());
+    psearch->bnTargetPerCoinDay.SetCompact(nBits);
+    psearch->nTimeTx = nTimeTx;
+    psearch->nHashDrift = nHashDrift;
+    psearch->nMinTime = nMinTime;
+    psearch->nHeightStart = chainActive.Height();
+    boost::shared_ptr<const std::vector<CStakeKernelInput> > pinputs(new std::vector<CStakeKernelInput>(vInputs));
+
+    //the queue hands out checks from the back, so add them in reverse to try the inputs roughly in order
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve(vInputs.size());
+    for (size_t i = vInputs.size(); i > 0; i--)
+        vChecks.push_back(CStakeKernelCheck(psearch, pinputs, i - 1));
+
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        TRY_LOCK(cs_stakekernelcheckqueue, lockQueue);
+        if (lockQueue && nStakeThreads) {
+            CCheckQueueControl<CStakeKernelCheck> control(&stakekernelcheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            for (std::vector<CStakeKernelCheck>::reverse_iterator it = vChecks.rbegin(); it != vChecks.rend(); ++it) {
+                if (!(*it)())
+                    break;
+            }
+        }
+    }
+    int64_t nTimeElapsed = GetTimeMicros() - nTimeStart;
+
+    {
+        LOCK(cs_stakekernelhashrate);
+        nStakeKernelHashRate = psearch->nHashes * 1000000 / std::max(nTimeElapsed, (int64_t)1);
+    }
+    if (fDebug)
+        LogPrintf("FindStakeKernel() : %d hashes over %u inputs in %.2fms\n", psearch->nHashes, vInputs.size(), nTimeElapsed * 0.001);
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+
+    if (!psearch->fFound)
+        return false;
+
+    nIndex = psearch->nIndex;
+    nTimeKernel = psearch->nTimeKernel;
+    hashProofOfStake = psearch->hashProofOfStake;
+
+    const CStakeKernelInput& input = vInputs[nIndex];
+    LogPrintf("FindStakeKernel() : using modifier %s at height=%d timestamp=%s for block from timestamp=%s\n",
+        boost::lexical_cast<std::string>(input.nStakeModifier).c_str(), input.nStakeModifierHeight,
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", input.nStakeModifierTime).c_str(),
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", input.nTimeBlockFrom).c_str());
+    LogPrintf("FindStakeKernel() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
+        "0.3",
+        boost::lexical_cast<std::string>(input.nStakeModifier).c_str(),
+        input.nTimeBlockFrom, input.prevout.hash.ToString().c_str(), input.nTimeBlockFrom, input.prevout.n, nTimeKernel,
+        hashProofOfStake.ToString().c_str());
+    return true;
+}
+
+int64_t GetStakeKernelHashRate()
+{
+    LOCK(cs_stakekernelhashrate);
+    return nStakeKernelHashRate;
+}
+
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, int64_t nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake)
+{
+    unsigned int nTimeBlockFrom = pindexFrom->GetBlockTime();
+
+    if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
+        return error("CheckStakeKernelHash() : nTime violation");
+
+    if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
+        return error("CheckStakeKernelHash() : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d", nTimeBlockFrom, nStakeMinAge, nTimeTx);
+
+    //grab difficulty
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    //grab stake modifier
+    uint64_t nStakeModifier = 0;
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
+        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
+        return false;
+    }
+
+    hashProofOfStake = CStakeKernelHasher(nStakeModifier, nTimeBlockFrom, prevout.n, prevout.hash).GetHash(nTimeTx);
+    return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
+}
+
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake)
 {
-    const CTransaction tx = block.vtx[1];
+    const CTransaction& tx = block.vtx[1];
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("CheckProofOfStake() : INFO: read txPrev failed");
+    // The kernel only needs the output being staked and the header of the block it is in.
+    // An unspent output is taken from the coins view, which saves reading the transaction
+    CScript scriptPubKeyPrev;
+    int64_t nValueIn = 0;
+    CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(txin.prevout.hash);
+        if (coins && coins->IsAvailable(txin.prevout.n) && coins->nHeight <= chainActive.Height()) {
+            scriptPubKeyPrev = coins->vout[txin.prevout.n].scriptPubKey;
+            nValueIn = coins->vout[txin.prevout.n].nValue;
+            pindex = chainActive[coins->nHeight];
+        }
+    }
 
-    //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
-        return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
+    // Otherwise try finding the previous transaction in database
+    if (!pindex) {
+        uint256 hashBlock;
+        CTransaction txPrev;
+        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
+            return error("CheckProofOfStake() : INFO: read txPrev failed");
+        if (txin.prevout.n >= txPrev.vout.size())
+            return error("CheckProofOfStake() : INFO: prevout out of range");
+
+        BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+        if (it != mapBlockIndex.end())
+            pindex = it->second;
+        else
+            return error("CheckProofOfStake() : read block failed");
 
-    CBlockIndex* pindex = NULL;
-    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
-    if (it != mapBlockIndex.end())
-        pindex = it->second;
-    else
-        return error("CheckProofOfStake() : read block failed");
+        scriptPubKeyPrev = txPrev.vout[txin.prevout.n].scriptPubKey;
+        nValueIn = txPrev.vout[txin.prevout.n].nValue;
+    }
 
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
+    //verify signature and script
+    if (!VerifyScript(txin.scriptSig, scriptPubKeyPrev, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+        return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    unsigned int nInterval = 0;
-    unsigned int nTime = block.nTime;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    if (!CheckStakeKernelHash(block.nBits, pindex, nValueIn, txin.prevout, block.nTime, hashProofOfStake, fDebug))
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
     return true;
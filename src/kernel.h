@@ -6,6 +6,7 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "hash.h"
 #include "main.h"
 
 
@@ -15,6 +16,15 @@ static const unsigned int MODIFIER_INTERVAL_TESTNET = 60;
 extern unsigned int nModifierInterval;
 extern unsigned int getIntervalVersion(bool fTestNet);
 
+/** Number of blocks from whose stake modifiers are kept in memory */
+static const unsigned int STAKE_MODIFIER_CACHE_SIZE = 50000;
+
+/** Maximum number of stake kernel search threads allowed */
+static const int MAX_STAKE_THREADS = 16;
+/** -stakethreads default (number of stake kernel search threads, 0 = auto) */
+static const int DEFAULT_STAKE_THREADS = 0;
+extern int nStakeThreads;
+
 // MODIFIER_INTERVAL_RATIO:
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
@@ -26,11 +36,54 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+/**
+ * Computes the same hash as stakeHash() for one stake input at any time. Everything except
+ * the time is serialized and fed to the hasher once, and each time only finishes a copy of it.
+ */
+class CStakeKernelHasher
+{
+private:
+    CHash256 hasher;
+
+public:
+    CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int prevoutIndex, const uint256& prevoutHash);
+
+    uint256 GetHash(unsigned int nTimeTx) const;
+};
+
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockHeader& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+// Check the kernel hash of a stake input of nValueIn at nTimeTx, with only the index entry of the block the input is in
+// Sets hashProofOfStake on success return
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, int64_t nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+
+/** Everything the kernel hash of one stake input depends on, apart from the time */
+struct CStakeKernelInput
+{
+    COutPoint prevout;
+    int64_t nValueIn;
+    unsigned int nTimeBlockFrom;
+    uint64_t nStakeModifier;
+    int nStakeModifierHeight;
+    int64_t nStakeModifierTime;
+};
+
+// Check the age of a stake input and look up its stake modifier, ready for FindStakeKernel()
+bool GetStakeKernelInput(const CBlockHeader& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, CStakeKernelInput& input, bool fPrintProofOfStake = false);
+
+// Search the kernels of all the inputs over nHashDrift seconds from nTimeTx, spread over the -stakethreads threads.
+// Stops at the first kernel newer than nMinTime or when the tip changes, and sets nIndex to the input it belongs to.
+bool FindStakeKernel(const std::vector<CStakeKernelInput>& vInputs, unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, int64_t nMinTime, size_t& nIndex, unsigned int& nTimeKernel, uint256& hashProofOfStake);
+
+// Kernel hashes per second of the last search
+int64_t GetStakeKernelHashRate();
+
+void ThreadStakeKernelCheck();
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
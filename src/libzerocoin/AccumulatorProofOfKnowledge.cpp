@@ -117,14 +117,19 @@ bool AccumulatorProofOfKnowledge:: Verify(const Accumulator& a, const CBigNum& v
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	const IntegerGroupParams& sGroup = params->accumulatorPoKCommitmentGroup;
+	const IntegerGroupParams& nGroup = params->accumulatorQRNCommitmentGroup;
+
+	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sGroup.gPow(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sGroup.hPow(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+	// (C * sg^-1)^s_gamma and (sg * C)^s_sigma are split so that the sg powers fold into a single sg exponentiation
+	CBigNum st_2_prime = (sGroup.gPow(c - s_gamma, params->accumulatorPoKCommitmentGroup.modulus) * valueOfCommitmentToCoin.pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus) * sGroup.hPow(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+	CBigNum st_3_prime = (sGroup.gPow(c + s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * valueOfCommitmentToCoin.pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sGroup.hPow(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+
+	// (h_n^-1)^x and (g_n^-1)^x are served from the h_n and g_n tables as h_n^-x and g_n^-x
+	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * nGroup.hPow(s_zeta, params->accumulatorModulus) * nGroup.gPow(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
+	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * nGroup.hPow(s_eta, params->accumulatorModulus) * nGroup.gPow(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
+	CBigNum t_3_prime = (CBigNum::mul_pow_mod({a.getValue(), C_u}, {c, s_alpha}, params->accumulatorModulus) * nGroup.hPow(-s_beta, params->accumulatorModulus)) % params->accumulatorModulus;
+	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * nGroup.hPow(-s_delta, params->accumulatorModulus) * nGroup.gPow(-s_beta, params->accumulatorModulus)) % params->accumulatorModulus;
 
 	bool result = false;
 
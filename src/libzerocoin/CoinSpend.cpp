@@ -58,7 +58,22 @@ CoinSpend::CoinSpend(const ZerocoinParams* p, const PrivateCoin& coin, Accumulat
 bool CoinSpend::Verify(const Accumulator& a) const
 {
     // Verify both of the sub-proofs using the given meta-data
-    return (a.getDenomination() == this->denomination) && commitmentPoK.Verify(serialCommitmentToCoinValue, accCommitmentToCoinValue) && accumulatorPoK.Verify(a, accCommitmentToCoinValue) && serialNumberSoK.Verify(coinSerialNumber, serialCommitmentToCoinValue, signatureHash());
+    return VerifyCommitmentPoK() && VerifyAccumulatorPoK(a) && VerifySerialNumberSoK();
+}
+
+bool CoinSpend::VerifyCommitmentPoK() const
+{
+    return commitmentPoK.Verify(serialCommitmentToCoinValue, accCommitmentToCoinValue);
+}
+
+bool CoinSpend::VerifyAccumulatorPoK(const Accumulator& a) const
+{
+    return (a.getDenomination() == this->denomination) && accumulatorPoK.Verify(a, accCommitmentToCoinValue);
+}
+
+bool CoinSpend::VerifySerialNumberSoK() const
+{
+    return serialNumberSoK.Verify(coinSerialNumber, serialCommitmentToCoinValue, signatureHash());
 }
 
 const uint256 CoinSpend::signatureHash() const
@@ -92,6 +92,13 @@ public:
     CBigNum getSerialComm() const { return serialCommitmentToCoinValue; }
 
     bool Verify(const Accumulator& a) const;
+
+    /** The three independent sub-proofs checked by Verify(). They share no state, so
+     * callers that want to spread the work over several threads may check them separately.
+     */
+    bool VerifyCommitmentPoK() const;
+    bool VerifyAccumulatorPoK(const Accumulator& a) const;
+    bool VerifySerialNumberSoK() const;
     bool HasValidSerial(ZerocoinParams* params) const;
     CBigNum CalculateValidSerial(ZerocoinParams* params);
 
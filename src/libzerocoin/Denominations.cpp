@@ -53,6 +53,26 @@ int64_t ZerocoinDenominationToInt(const CoinDenomination& denomination)
     return Value;
 }
 
+// Position in zerocoinDenomList, or -1 for ZQ_ERROR and anything else that is not a denomination
+int ZerocoinDenominationToIndex(const CoinDenomination& denomination)
+{
+    int nIndex = -1;
+    switch (denomination) {
+    case CoinDenomination::ZQ_ONE: nIndex = 0; break;
+    case CoinDenomination::ZQ_FIVE: nIndex = 1; break;
+    case CoinDenomination::ZQ_TEN: nIndex = 2; break;
+    case CoinDenomination::ZQ_FIFTY : nIndex = 3; break;
+    case CoinDenomination::ZQ_ONE_HUNDRED: nIndex = 4; break;
+    case CoinDenomination::ZQ_FIVE_HUNDRED: nIndex = 5; break;
+    case CoinDenomination::ZQ_ONE_THOUSAND: nIndex = 6; break;
+    case CoinDenomination::ZQ_FIVE_THOUSAND: nIndex = 7; break;
+    default:
+        // Error Case
+        nIndex = -1; break;
+    }
+    return nIndex;
+}
+
 CoinDenomination AmountToZerocoinDenomination(CAmount amount)
 {
     // Check to make sure amount is an exact integer number of COINS
@@ -34,9 +34,12 @@ const std::vector<CoinDenomination> zerocoinDenomList = {ZQ_ONE, ZQ_FIVE, ZQ_TEN
 // These are the max number you'd need at any one Denomination before moving to the higher denomination. Last number is 4, since it's the max number of
 // possible spends at the moment    /
 const std::vector<int> maxCoinsAtDenom   = {4, 1, 4, 1, 4, 1, 4, 4};
+// The number of denominations in zerocoinDenomList
+const int ZEROCOIN_DENOMINATIONS = 8;
 
 int64_t ZerocoinDenominationToInt(const CoinDenomination& denomination);
 int64_t ZerocoinDenominationToAmount(const CoinDenomination& denomination);
+int ZerocoinDenominationToIndex(const CoinDenomination& denomination);
 CoinDenomination IntToZerocoinDenomination(int64_t amount);
 CoinDenomination AmountToZerocoinDenomination(int64_t amount);
 CoinDenomination AmountToClosestDenomination(int64_t nAmount, int64_t& nRemaining);
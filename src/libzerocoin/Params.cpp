@@ -12,6 +12,7 @@
 // Copyright (c) 2017 The PIVX developers
 // Copyright (c) 2018 The Wagerr developers
 #include "Params.h"
+#include "Commitment.h"
 #include "ParamGeneration.h"
 
 namespace libzerocoin {
@@ -26,6 +27,24 @@ ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	// Generate the parameters
 	CalculateParams(*this, N, ZEROCOIN_PROTOCOL_VERSION, securityLevel);
 
+	// Precompute the generators used by proof verification. Each table covers the
+	// widest exponent the proofs put on that base; wider ones fall back to pow_mod.
+	//  - coin commitment group: exponents are reduced mod its group order
+	//  - serial number SoK group: SoK responses are products of two group order sized values,
+	//    commitment PoK responses are bounded by the commitment PoK random size
+	//  - accumulator PoK group: commitment PoK responses, and s_alpha of the accumulator PoK
+	//  - QRN group: s_beta and s_delta of the accumulator PoK, taken mod the accumulator modulus
+	uint32_t nCommitmentPoKBits = COMMITMENT_EQUALITY_CHALLENGE_SIZE + COMMITMENT_EQUALITY_SECMARGIN + 1 +
+	                              std::max(std::max(this->serialNumberSoKCommitmentGroup.modulus.bitSize(), this->accumulatorParams.accumulatorPoKCommitmentGroup.modulus.bitSize()),
+	                                       std::max(this->serialNumberSoKCommitmentGroup.groupOrder.bitSize(), this->accumulatorParams.accumulatorPoKCommitmentGroup.groupOrder.bitSize()));
+	uint32_t nAccumulatorPoKBits = HASH_OUTPUT_BITS + this->accumulatorParams.accumulatorModulus.bitSize() + this->accumulatorParams.maxCoinValue.bitSize() + 1;
+
+	this->coinCommitmentGroup.PrecomputeFixedBases(this->coinCommitmentGroup.modulus, this->coinCommitmentGroup.groupOrder.bitSize() + 1);
+	this->serialNumberSoKCommitmentGroup.PrecomputeFixedBases(this->serialNumberSoKCommitmentGroup.modulus,
+	                                                          std::max(2 * this->serialNumberSoKCommitmentGroup.groupOrder.bitSize() + 1, (int)nCommitmentPoKBits));
+	this->accumulatorParams.accumulatorPoKCommitmentGroup.PrecomputeFixedBases(this->accumulatorParams.accumulatorPoKCommitmentGroup.modulus, nCommitmentPoKBits);
+	this->accumulatorParams.accumulatorQRNCommitmentGroup.PrecomputeFixedBases(this->accumulatorParams.accumulatorModulus, nAccumulatorPoKBits);
+
 	this->accumulatorParams.initialized = true;
 	this->initialized = true;
 }
@@ -45,4 +64,21 @@ CBigNum IntegerGroupParams::randomElement() const {
 	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
 }
 
+void IntegerGroupParams::PrecomputeFixedBases(const CBigNum& groupModulus, uint32_t nMaxExponentBits) {
+	this->gFixedBase = CBigNumFixedBase(this->g, groupModulus, nMaxExponentBits);
+	this->hFixedBase = CBigNumFixedBase(this->h, groupModulus, nMaxExponentBits);
+}
+
+CBigNum IntegerGroupParams::gPow(const CBigNum& e, const CBigNum& m) const {
+	if (this->gFixedBase.IsNull() || this->gFixedBase.getModulus() != m)
+		return this->g.pow_mod(e, m);
+	return this->gFixedBase.pow_mod(e);
+}
+
+CBigNum IntegerGroupParams::hPow(const CBigNum& e, const CBigNum& m) const {
+	if (this->hFixedBase.IsNull() || this->hFixedBase.getModulus() != m)
+		return this->h.pow_mod(e, m);
+	return this->hFixedBase.pow_mod(e);
+}
+
 } /* namespace libzerocoin */
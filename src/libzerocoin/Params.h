@@ -32,6 +32,20 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Builds the fixed-base tables for g and h, serving exponents of up to
+	 * nMaxExponentBits bits mod groupModulus. This is normally the group modulus,
+	 * but the QRN group is taken mod the accumulator modulus.
+	 */
+	void PrecomputeFixedBases(const CBigNum& groupModulus, uint32_t nMaxExponentBits);
+
+	/** g^e mod m, served from the precomputed table when it was built for m */
+	CBigNum gPow(const CBigNum& e, const CBigNum& m) const;
+
+	/** h^e mod m, served from the precomputed table when it was built for m */
+	CBigNum hPow(const CBigNum& e, const CBigNum& m) const;
+
 	bool initialized;
 
 	/**
@@ -56,6 +70,13 @@ public:
 	 */
 	CBigNum groupOrder;
 
+	/**
+	 * Precomputed powers of g and h. These are derived from the fields above
+	 * and are not serialized.
+	 */
+	CBigNumFixedBase gFixedBase;
+	CBigNumFixedBase hFixedBase;
+
 	ADD_SERIALIZE_METHODS;
   template <typename Stream, typename Operation>  inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
 		    READWRITE(initialized);
@@ -78,9 +78,10 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
         }
 	}
 
+	CBigNum aPow = params->coinCommitmentGroup.gPow(coin.getSerialNumber(), params->serialNumberSoKCommitmentGroup.groupOrder);
 	for(uint32_t i=0; i < params->zkp_iterations; i++) {
 		// compute g^{ {a^x b^r} h^v} mod p2
-		c[i] = challengeCalculation(coin.getSerialNumber(), r[i], v_expanded[i]);
+		c[i] = challengeCalculation(aPow, r[i], v_expanded[i]);
 	}
 
 	// We can't hash data in parallel either
@@ -108,42 +109,39 @@ SerialNumberSignatureOfKnowledge::SerialNumberSignatureOfKnowledge(const
 	}
 }
 
-inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_exp,const CBigNum& b_exp,
+inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBigNum& a_pow,const CBigNum& b_exp,
         const CBigNum& h_exp) const {
 
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
-
-	CBigNum exponent = (a.pow_mod(a_exp, params->serialNumberSoKCommitmentGroup.groupOrder)
-	                   * b.pow_mod(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
+	// a and b are the generators of the coin commitment group, whose modulus is the order of the SoK group
+	CBigNum exponent = (a_pow * params->coinCommitmentGroup.hPow(b_exp, params->serialNumberSoKCommitmentGroup.groupOrder)) % params->serialNumberSoKCommitmentGroup.groupOrder;
 
-	return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
+	return (params->serialNumberSoKCommitmentGroup.gPow(exponent, params->serialNumberSoKCommitmentGroup.modulus) * params->serialNumberSoKCommitmentGroup.hPow(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
 }
 
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
         const uint256 msghash) const {
-	CBigNum a = params->coinCommitmentGroup.g;
-	CBigNum b = params->coinCommitmentGroup.h;
-	CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-	CBigNum h = params->serialNumberSoKCommitmentGroup.h;
 	CHashWriter hasher(0,0);
 	hasher << *params << valueOfCommitmentToCoin << coinSerialNumber << msghash;
 
 	vector<CBigNum> tprime(params->zkp_iterations);
 	unsigned char *hashbytes = (unsigned char*) &this->hash;
 
+	// Roughly half of the iterations raise the commitment to an exponent mod the SoK group
+	// order, so the commitment gets a table of its own for the length of this proof
+	CBigNumFixedBase commitmentFixedBase(valueOfCommitmentToCoin, params->serialNumberSoKCommitmentGroup.modulus,
+	                                     params->serialNumberSoKCommitmentGroup.groupOrder.bitSize());
+	CBigNum aPow = params->coinCommitmentGroup.gPow(coinSerialNumber, params->serialNumberSoKCommitmentGroup.groupOrder);
+
 	for(uint32_t i = 0; i < params->zkp_iterations; i++) {
 		int bit = i % 8;
 		int byte = i / 8;
 		bool challenge_bit = ((hashbytes[byte] >> bit) & 0x01);
 		if(challenge_bit) {
-			tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
+			tprime[i] = challengeCalculation(aPow, s_notprime[i], SeedTo1024(sprime[i].getuint256()));
 		} else {
-			CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-			tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus) *
-			             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) % params->serialNumberSoKCommitmentGroup.modulus)) %
+			CBigNum exp = params->coinCommitmentGroup.hPow(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
+			tprime[i] = (commitmentFixedBase.pow_mod(exp) *
+			             params->serialNumberSoKCommitmentGroup.hPow(sprime[i], params->serialNumberSoKCommitmentGroup.modulus)) %
 			            params->serialNumberSoKCommitmentGroup.modulus;
 		}
 	}
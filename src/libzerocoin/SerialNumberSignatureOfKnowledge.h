@@ -68,7 +68,8 @@ private:
 	// define something named s and it conflicts
 	vector<CBigNum> s_notprime;
 	vector<CBigNum> sprime;
-	inline CBigNum challengeCalculation(const CBigNum& a_exp, const CBigNum& b_exp,
+	// a_pow is a^x mod q for the coin serial x, which is the same in every iteration
+	inline CBigNum challengeCalculation(const CBigNum& a_pow, const CBigNum& b_exp,
 	                                   const CBigNum& h_exp) const;
 };
 
@@ -7,6 +7,7 @@
 #ifndef BITCOIN_BIGNUM_H
 #define BITCOIN_BIGNUM_H
 
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include <openssl/bn.h>
@@ -545,6 +546,111 @@ public:
         return ret;
     }
 
+    /**
+     * simultaneous modular multi-exponentiation: prod(bases[i]^exps[i]) mod m
+     * Interleaves a sliding window over every exponent (Straus' method), so the
+     * squarings are shared between all the bases and each base only costs one
+     * multiplication per window of its own exponent.
+     * @param bases the bases
+     * @param exps the exponents, one per base, may be negative
+     * @param m modulus
+     */
+    static CBigNum mul_pow_mod(const std::vector<CBigNum>& bases, const std::vector<CBigNum>& exps, const CBigNum& m) {
+        if (bases.size() != exps.size())
+            throw bignum_error("CBigNum::mul_pow_mod : bases and exponents differ in size");
+
+        // Montgomery multiplication needs an odd modulus
+        if (!BN_is_odd(m.bn)) {
+            CBigNum ret = CBigNum(1) % m;
+            for (unsigned int i = 0; i < bases.size(); i++)
+                ret = ret.mul_mod(bases[i].pow_mod(exps[i], m), m);
+            return ret;
+        }
+
+        CAutoBN_CTX pctx;
+        std::shared_ptr<BN_MONT_CTX> mont(BN_MONT_CTX_new(), BN_MONT_CTX_free);
+        if (!mont || !BN_MONT_CTX_set(mont.get(), m.bn, pctx))
+            throw bignum_error("CBigNum::mul_pow_mod : BN_MONT_CTX_set failed");
+
+        // For every base, the odd powers b^1, b^3, ..., b^(2^w - 1) in Montgomery
+        // form, and the windows of its exponent as (lowest bit, odd digit) pairs
+        std::vector<std::vector<CBigNum> > vPowers(bases.size());
+        std::vector<std::vector<std::pair<int, unsigned int> > > vWindows(bases.size());
+        int nTopBit = -1;
+        for (unsigned int i = 0; i < bases.size(); i++) {
+            CBigNum b = bases[i] % m;
+            CBigNum e = exps[i];
+            if (e < 0) {
+                // g^-x = (g^-1)^x
+                b = b.inverse(m);
+                e = -e;
+            }
+            const int nBits = e.bitSize();
+            if (nBits == 0)
+                continue;
+
+            const int nWindowBits = nBits > 671 ? 6 : nBits > 239 ? 5 : nBits > 79 ? 4 : nBits > 23 ? 3 : 1;
+            std::vector<CBigNum>& powers = vPowers[i];
+            powers.resize(1 << (nWindowBits - 1));
+            if (!BN_to_montgomery(powers[0].bn, b.bn, mont.get(), pctx))
+                throw bignum_error("CBigNum::mul_pow_mod : BN_to_montgomery failed");
+            if (powers.size() > 1) {
+                CBigNum b2;
+                if (!BN_mod_mul_montgomery(b2.bn, powers[0].bn, powers[0].bn, mont.get(), pctx))
+                    throw bignum_error("CBigNum::mul_pow_mod : BN_mod_mul_montgomery failed");
+                for (unsigned int j = 1; j < powers.size(); j++) {
+                    if (!BN_mod_mul_montgomery(powers[j].bn, powers[j - 1].bn, b2.bn, mont.get(), pctx))
+                        throw bignum_error("CBigNum::mul_pow_mod : BN_mod_mul_montgomery failed");
+                }
+            }
+
+            for (int nBit = nBits - 1; nBit >= 0;) {
+                if (!BN_is_bit_set(e.bn, nBit)) {
+                    nBit--;
+                    continue;
+                }
+                // longest window starting at nBit that ends in a set bit
+                int nLow = std::max(nBit - nWindowBits + 1, 0);
+                while (!BN_is_bit_set(e.bn, nLow))
+                    nLow++;
+                unsigned int nDigit = 0;
+                for (int j = nBit; j >= nLow; j--)
+                    nDigit = (nDigit << 1) | (BN_is_bit_set(e.bn, j) ? 1 : 0);
+                vWindows[i].push_back(std::make_pair(nLow, nDigit));
+                nBit = nLow - 1;
+            }
+            nTopBit = std::max(nTopBit, nBits - 1);
+        }
+
+        // all exponents are zero
+        if (nTopBit < 0)
+            return CBigNum(1) % m;
+
+        CBigNum ret;
+        bool fEmpty = true;
+        std::vector<unsigned int> vNext(bases.size(), 0);
+        for (int nBit = nTopBit; nBit >= 0; nBit--) {
+            if (!fEmpty && !BN_mod_mul_montgomery(ret.bn, ret.bn, ret.bn, mont.get(), pctx))
+                throw bignum_error("CBigNum::mul_pow_mod : BN_mod_mul_montgomery failed");
+            for (unsigned int i = 0; i < bases.size(); i++) {
+                if (vNext[i] == vWindows[i].size() || vWindows[i][vNext[i]].first != nBit)
+                    continue;
+                const CBigNum& power = vPowers[i][vWindows[i][vNext[i]].second >> 1];
+                vNext[i]++;
+                if (fEmpty) {
+                    ret = power;
+                    fEmpty = false;
+                } else if (!BN_mod_mul_montgomery(ret.bn, ret.bn, power.bn, mont.get(), pctx)) {
+                    throw bignum_error("CBigNum::mul_pow_mod : BN_mod_mul_montgomery failed");
+                }
+            }
+        }
+
+        if (!BN_from_montgomery(ret.bn, ret.bn, mont.get(), pctx))
+            throw bignum_error("CBigNum::mul_pow_mod : BN_from_montgomery failed");
+        return ret;
+    }
+
    /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
@@ -722,6 +828,7 @@ public:
     friend inline bool operator>=(const CBigNum& a, const CBigNum& b);
     friend inline bool operator<(const CBigNum& a, const CBigNum& b);
     friend inline bool operator>(const CBigNum& a, const CBigNum& b);
+    friend class CBigNumFixedBase;
 };
 
 
@@ -799,6 +906,115 @@ inline bool operator<(const CBigNum& a, const CBigNum& b)  { return (BN_cmp(a.bn
 inline bool operator>(const CBigNum& a, const CBigNum& b)  { return (BN_cmp(a.bn, b.bn) > 0); }
 inline std::ostream& operator<<(std::ostream &strm, const CBigNum &b) { return strm << b.ToString(10); }
 
+/**
+ * Modular exponentiation base^e mod m for a base and modulus that never change.
+ * The powers base^(d * 2^(w*i)) for every w-bit window i and window digit d are
+ * computed once, in Montgomery form, so that an exponentiation costs one modular
+ * multiplication per non-zero window and no squarings at all.
+ * The table is shared between copies and is read-only once built, so it may be
+ * used from several threads at once. Exponents wider than the table, and even
+ * moduli, fall back to CBigNum::pow_mod().
+ */
+class CBigNumFixedBase
+{
+    static const unsigned int WINDOW_BITS = 4;
+    static const unsigned int WINDOW_DIGITS = (1 << WINDOW_BITS) - 1;
+
+    CBigNum base;
+    CBigNum modulus;
+    unsigned int nMaxExponentBits;
+    std::shared_ptr<BN_MONT_CTX> mont;
+    std::shared_ptr<const std::vector<CBigNum> > table;
+
+public:
+    CBigNumFixedBase() : nMaxExponentBits(0) {}
+
+    /**
+     * Precompute the table for base mod m
+     * @param nMaxExponentBitsIn the widest exponent served from the table
+     */
+    CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxExponentBitsIn) : base(baseIn), modulus(modulusIn), nMaxExponentBits(0)
+    {
+        if (!BN_is_odd(modulus.bn) || nMaxExponentBitsIn == 0)
+            return;
+
+        CAutoBN_CTX pctx;
+        mont.reset(BN_MONT_CTX_new(), BN_MONT_CTX_free);
+        if (!mont || !BN_MONT_CTX_set(mont.get(), modulus.bn, pctx))
+            throw bignum_error("CBigNumFixedBase : BN_MONT_CTX_set failed");
+
+        const unsigned int nWindows = (nMaxExponentBitsIn + WINDOW_BITS - 1) / WINDOW_BITS;
+        std::shared_ptr<std::vector<CBigNum> > vTable(new std::vector<CBigNum>(nWindows * WINDOW_DIGITS));
+
+        // b = base^(2^(w*i)), starting at window 0
+        CBigNum b = base % modulus;
+        if (!BN_to_montgomery(b.bn, b.bn, mont.get(), pctx))
+            throw bignum_error("CBigNumFixedBase : BN_to_montgomery failed");
+        for (unsigned int i = 0; i < nWindows; i++) {
+            CBigNum* row = &(*vTable)[i * WINDOW_DIGITS];
+            row[0] = b;
+            for (unsigned int d = 1; d < WINDOW_DIGITS; d++) {
+                if (!BN_mod_mul_montgomery(row[d].bn, row[d - 1].bn, b.bn, mont.get(), pctx))
+                    throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+            }
+            // base^(2^(w*(i+1))) = base^((2^w - 1) * 2^(w*i)) * base^(2^(w*i))
+            if (!BN_mod_mul_montgomery(b.bn, row[WINDOW_DIGITS - 1].bn, b.bn, mont.get(), pctx))
+                throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+        }
+
+        table = vTable;
+        nMaxExponentBits = nWindows * WINDOW_BITS;
+    }
+
+    bool IsNull() const { return !table; }
+    const CBigNum& getBase() const { return base; }
+    const CBigNum& getModulus() const { return modulus; }
+
+    /**
+     * fixed-base modular exponentiation: base^e mod m
+     * @param e exponent
+     */
+    CBigNum pow_mod(const CBigNum& e) const
+    {
+        // g^-x = (g^x)^-1
+        if (e < 0)
+            return pow_mod(-e).inverse(modulus);
+
+        if (IsNull() || (unsigned int)e.bitSize() > nMaxExponentBits)
+            return base.pow_mod(e, modulus);
+
+        CAutoBN_CTX pctx;
+        CBigNum ret;
+        bool fEmpty = true;
+        const unsigned int nBits = e.bitSize();
+        for (unsigned int i = 0; i * WINDOW_BITS < nBits; i++) {
+            unsigned int d = 0;
+            for (unsigned int j = 0; j < WINDOW_BITS; j++) {
+                if (BN_is_bit_set(e.bn, i * WINDOW_BITS + j))
+                    d |= (1 << j);
+            }
+            if (d == 0)
+                continue;
+
+            const CBigNum& entry = (*table)[i * WINDOW_DIGITS + d - 1];
+            if (fEmpty) {
+                ret = entry;
+                fEmpty = false;
+            } else if (!BN_mod_mul_montgomery(ret.bn, ret.bn, entry.bn, mont.get(), pctx)) {
+                throw bignum_error("CBigNumFixedBase::pow_mod : BN_mod_mul_montgomery failed");
+            }
+        }
+
+        // e == 0
+        if (fEmpty)
+            return CBigNum(1) % modulus;
+
+        if (!BN_from_montgomery(ret.bn, ret.bn, mont.get(), pctx))
+            throw bignum_error("CBigNumFixedBase::pow_mod : BN_from_montgomery failed");
+        return ret;
+    }
+};
+
 typedef CBigNum Bignum;
 
 #endif
@@ -18,6 +18,7 @@
 #include "kernel.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
+#include "masternode-sigcheck.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -32,10 +33,12 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
+#include "zerocoinspendcache.h"
 
 #include "primitives/zerocoin.h"
 #include "libzerocoin/Denominations.h"
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -104,6 +107,7 @@ map<uint256, int64_t> mapRejectedBlocks;
 void EraseOrphansFor(NodeId peer);
 
 static void CheckBlockIndex();
+static void SetBlockStakeState(CBlockIndex* pindexNew);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -185,6 +189,12 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/**
+ * Held while a masternode, payment or budget message is processed, and while a new block updates
+ * the same state, so the two take turns. Taken before cs_budget and cs_main.
+ */
+CCriticalSection cs_masternodeMessages;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -227,6 +237,10 @@ struct CNodeState {
     CBlockIndex* pindexLastCommonBlock;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! Number of getheaders sent to this peer that it has not answered yet.
+    int nHeadersRequested;
+    //! Whether headers synchronization waits for the active chain to catch up, see MAX_STAKE_HEADERS_AHEAD.
+    bool fHeadersPaused;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     list<QueuedBlock> vBlocksInFlight;
@@ -243,6 +257,8 @@ struct CNodeState {
         hashLastUnknownBlock = uint256(0);
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
+        nHeadersRequested = 0;
+        fHeadersPaused = false;
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
@@ -283,6 +299,30 @@ void UpdatePreferredDownload(CNode* node, CNodeState* state)
     nPreferredDownload += state->fPreferredDownload;
 }
 
+/** Whether we sync headers-first with this peer: older peers answer getheaders with block invs. */
+bool IsHeadersFirstPeer(const CNode* pnode)
+{
+    return Params().HeadersFirstSyncingActive() && pnode->nVersion >= HEADERS_FIRST_VERSION;
+}
+
+/** Ask a peer for the headers after pindexStart, up to hashStop. Only answers to these are accepted. Requires cs_main. */
+void PushGetHeaders(CNode* pnode, CBlockIndex* pindexStart, const uint256& hashStop)
+{
+    CNodeState* state = State(pnode->GetId());
+    if (state)
+        state->nHeadersRequested++;
+    pnode->PushMessage("getheaders", chainActive.GetLocator(pindexStart), hashStop);
+}
+
+/** Ask a peer for the part of its chain we miss, up to hashStop. Requires cs_main. */
+void PushGetBlocks(CNode* pnode, const uint256& hashStop)
+{
+    if (IsHeadersFirstPeer(pnode))
+        PushGetHeaders(pnode, pindexBestHeader, hashStop);
+    else
+        pnode->PushMessage("getblocks", chainActive.GetLocator(), hashStop);
+}
+
 void InitializeNode(NodeId nodeid, const CNode* pnode)
 {
     LOCK(cs_main);
@@ -396,6 +436,16 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb)
     return pa;
 }
 
+/** Only nBits and the timestamp of a staked header can be checked before its kernel, so the work of
+ *  a staked header-only entry is taken on trust only when it leads to a checkpoint. Requires cs_main. */
+bool IsHeaderWorkTrusted(const CBlockIndex* pindex)
+{
+    if (!(pindex->nStatus & BLOCK_STAKE_UNCHECKED) || pindex->nHeight <= Params().LAST_POW_BLOCK())
+        return true;
+    const CBlockIndex* pindexCheckpoint = Checkpoints::GetLastCheckpoint();
+    return pindexCheckpoint && pindexCheckpoint->GetAncestor(pindex->nHeight) == pindex;
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller)
@@ -460,6 +510,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
+                if (!IsHeaderWorkTrusted(pindex) && !chainActive.Contains(pindex->pprev)) {
+                    // Its kernel is checked when it is accepted, which needs the parent connected.
+                    return;
+                }
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
@@ -1000,25 +1054,30 @@ void FindMints(vector<CZerocoinMint> vMintsToFind, vector<CZerocoinMint>& vMints
             if(i % 1000 == 0)
                 LogPrintf("%s : scanned %d blocks\n", __func__, i - nZerocoinStartHeight);
 
-            if(chainActive[i]->vMintDenominationsInBlock.empty())
+            if(!chainActive[i]->GetMintCount())
                 continue;
 
-            CBlock block;
-            if(!ReadBlockFromDisk(block, chainActive[i]))
-                continue;
+            // read the blocks mints from the mint index, one denomination at a time
+            for (CoinDenomination denom : zerocoinDenomList) {
+                if (!chainActive[i]->MintedDenomination(denom))
+                    continue;
 
-            list<CZerocoinMint> vMints;
-            if(!BlockToZerocoinMintList(block, vMints, true))
-                continue;
+                vector<CZerocoinMintIndexEntry> vMints;
+                if(!GetIndexedMints(chainActive[i], denom, vMints))
+                    continue;
 
-            // search the blocks mints to see if it contains the mint that is requesting meta data updates
-            for (CZerocoinMint mintBlockChain : vMints) {
-                for (CZerocoinMint mintMissing : vMissingMints) {
-                    if (mintMissing.GetValue() == mintBlockChain.GetValue()) {
-                        LogPrintf("%s FOUND %s in block %d\n", __func__, mintMissing.GetValue().GetHex(), i);
-                        mintMissing.SetHeight(i);
-                        mintMissing.SetTxHash(mintBlockChain.GetTxHash());
-                        vMintsToUpdate.push_back(mintMissing);
+                // search the blocks mints to see if it contains the mint that is requesting meta data updates
+                for (const CZerocoinMintIndexEntry& mintBlockChain : vMints) {
+                    if (!IsValidMintIndexEntry(mintBlockChain))
+                        continue;
+
+                    for (CZerocoinMint mintMissing : vMissingMints) {
+                        if (mintMissing.GetValue() == mintBlockChain.bnValue) {
+                            LogPrintf("%s FOUND %s in block %d\n", __func__, mintMissing.GetValue().GetHex(), i);
+                            mintMissing.SetHeight(i);
+                            mintMissing.SetTxHash(mintBlockChain.hashTx);
+                            vMintsToUpdate.push_back(mintMissing);
+                        }
                     }
                 }
             }
@@ -1286,7 +1345,7 @@ bool IsZerocoinSpendUnknown(CoinSpend coinSpend, uint256 hashTx, CValidationStat
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1341,9 +1400,21 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
 
             Accumulator accumulator(Params().Zerocoin_Params(), newSpend.getDenomination(), bnAccumulatorValue);
 
-            //Check that the coin is on the accumulator
-            if(!newSpend.Verify(accumulator))
+            if (IsZerocoinSpendVerified(newSpend, bnAccumulatorValue)) {
+                // Already verified when it was accepted into the memory pool
+            } else if (pvChecks) {
+                // Defer the proofs to the spend check queue, one check per sub-proof
+                boost::shared_ptr<const CoinSpend> pspend(new CoinSpend(newSpend));
+                boost::shared_ptr<const Accumulator> paccumulator(new Accumulator(accumulator));
+                pvChecks->push_back(CZerocoinSpendCheck(pspend, paccumulator, CZerocoinSpendCheck::COMMITMENT_POK, tx.GetHash()));
+                pvChecks->push_back(CZerocoinSpendCheck(pspend, paccumulator, CZerocoinSpendCheck::ACCUMULATOR_POK, tx.GetHash()));
+                pvChecks->push_back(CZerocoinSpendCheck(pspend, paccumulator, CZerocoinSpendCheck::SERIAL_SOK, tx.GetHash()));
+            } else if (!newSpend.Verify(accumulator)) {
+                //Check that the coin is on the accumulator
                 return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            } else {
+                SetZerocoinSpendVerified(newSpend, bnAccumulatorValue);
+            }
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1362,13 +1433,10 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
 
     // Send signal to wallet if this is ours
     if (pwalletMain) {
-        CWalletDB walletdb(pwalletMain->strWalletFile);
-        list <CBigNum> listMySerials = walletdb.ListMintedCoinsSerial();
         for (const auto& newSpend : vSpends) {
-            list<CBigNum>::iterator it = find(listMySerials.begin(), listMySerials.end(), newSpend.getCoinSerialNumber());
-            if (it != listMySerials.end()) {
-                LogPrintf("%s: %s detected spent zerocoin mint in transaction %s \n", __func__, it->GetHex(), tx.GetHash().GetHex());
-                pwalletMain->NotifyZerocoinChanged(pwalletMain, it->GetHex(), "Used", CT_UPDATED);
+            if (pwalletMain->IsMyUnusedZerocoinSerial(newSpend.getCoinSerialNumber())) {
+                LogPrintf("%s: %s detected spent zerocoin mint in transaction %s \n", __func__, newSpend.getCoinSerialNumber().GetHex(), tx.GetHash().GetHex());
+                pwalletMain->NotifyZerocoinChanged(pwalletMain, newSpend.getCoinSerialNumber().GetHex(), "Used", CT_UPDATED);
             }
         }
     }
@@ -1376,7 +1444,7 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1432,7 +1500,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, pvSpendChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1680,7 +1748,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = 0;
         if (!tx.IsZerocoinSpend())
-            view.GetPriority(tx, chainActive.Height());
+            dPriority = view.GetPriority(tx, chainActive.Height());
 
         CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
         unsigned int nSize = entry.GetTxSize();
@@ -1733,6 +1801,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 hash.ToString(),
                 nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Keep chains of unconfirmed transactions short, so updating the mempool for one stays cheap
+        {
+            size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+            size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+            size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+            size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+            std::set<uint256> setAncestors;
+            std::string errString;
+            LOCK(pool.cs);
+            if (!pool.CalculateMemPoolAncestors(tx, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString))
+                return state.DoS(0, error("AcceptToMemoryPool : too long mempool chain %s, %s", hash.ToString(), errString),
+                    REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
@@ -2088,6 +2170,42 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CDiskBlockPos& pos, const uint256& hash)
+{
+    // The block is preceded by the network magic and its size, see WriteBlockToDisk()
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid position %u in file %d", __func__, pos.nPos, pos.nFile);
+
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - (MESSAGE_START_SIZE + sizeof(unsigned int)));
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE))
+            return error("%s : bad message start at %u in file %d", __func__, pos.nPos, pos.nFile);
+        if (nSize == 0 || nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : bad block size %u at %u in file %d", __func__, nSize, pos.nPos, pos.nFile);
+
+        ssBlock.resize(nSize);
+        filein.read(&ssBlock[0], nSize);
+
+        // Check the header belongs to the block asked for, without deserializing the transactions
+        CBlockHeader header;
+        ssBlock >> header;
+        ssBlock.Rewind(nSize - ssBlock.size());
+        if (header.GetHash() != hash)
+            return error("%s : block=%s index=%s", __func__, header.GetHash().ToString(), hash.ToString());
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2758,6 +2876,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
+    UncachePubcoins(pindex);
+
     if (!fVerifyingBlocks) {
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
@@ -2765,6 +2885,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+
+        if (!zerocoinDB->EraseBlockMints(pindex->nHeight))
+            return error("DisconnectBlock(): failed to erase indexed zerocoin mints");
     }
 
     if (pfClean) {
@@ -2808,6 +2931,42 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+/** The spend check queue is shared by all callers of CheckBlock; only one of them may feed it at a time.
+ *  Each check is a full zero-knowledge proof verification, so they are handed out one at a time. */
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(1);
+static CCriticalSection cs_zerocoinspendcheckqueue;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("wagerr-zspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    bool fVerified = false;
+    try {
+        switch (proof) {
+        case COMMITMENT_POK:
+            fVerified = pspend->VerifyCommitmentPoK();
+            break;
+        case ACCUMULATOR_POK:
+            fVerified = pspend->VerifyAccumulatorPoK(*paccumulator);
+            break;
+        case SERIAL_SOK:
+            fVerified = pspend->VerifySerialNumberSoK();
+            break;
+        }
+    } catch (const std::exception& e) {
+        return ::error("CZerocoinSpendCheck(): %s:%d exception while verifying spend: %s", hashTx.ToString(), proof, e.what());
+    }
+
+    if (!fVerified)
+        return ::error("CZerocoinSpendCheck(): %s:%d zerocoin spend did not verify", hashTx.ToString(), proof);
+
+    return true;
+}
+
 void RecalculateZWGRMinted()
 {
     CBlockIndex *pindex = chainActive[Params().Zerocoin_StartHeight()];
@@ -2823,10 +2982,9 @@ void RecalculateZWGRMinted()
         std::list<CZerocoinMint> listMints;
         BlockToZerocoinMintList(block, listMints, true);
 
-        vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
+        pindex->ClearMints();
         for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+            pindex->AddMint(mint.GetDenomination());
 
         if (pindex->nHeight < nHeightEnd)
             pindex = chainActive.Next(pindex);
@@ -2849,17 +3007,15 @@ void RecalculateZWGRSpent()
         list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->SetZerocoinSupply(*pindex->pprev);
 
         //Add mints to zWGR supply
-        for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
-        }
+        for (auto denom : libzerocoin::zerocoinDenomList)
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) + pindex->GetMintCount(denom));
 
         //Remove spends from zWGR supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) - 1);
 
         //Rewrite money supply
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -3029,6 +3185,30 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
+    if (!fJustCheck) {
+        // Stake fields of a block indexed from its header, with the kernel of a block that was
+        // stored ahead of its parent, see AddToBlockIndex() and AcceptBlock()
+        if (pindex->nStatus & BLOCK_STAKE_UNCHECKED) {
+            uint256 hash = block.GetHash();
+            if (block.IsProofOfStake() && !mapProofOfStake.count(hash)) {
+                uint256 hashProofOfStake;
+                if (!CheckProofOfStake(block, hashProofOfStake))
+                    return state.DoS(100, error("ConnectBlock() : check proof-of-stake failed for block %s", hash.ToString()),
+                        REJECT_INVALID, "bad-cs-kernel");
+                mapProofOfStake.insert(make_pair(hash, hashProofOfStake));
+            }
+            pindex->nStatus &= ~BLOCK_STAKE_UNCHECKED;
+            SetBlockStakeState(pindex);
+            setDirtyBlockIndex.insert(pindex);
+            if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindex->nChainWork)
+                pindexBestHeader = pindex;
+        }
+
+        if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
+            return state.DoS(100, error("ConnectBlock() : rejected by stake modifier checkpoint height=%d", pindex->nHeight),
+                REJECT_INVALID, "bad-modifier-checksum");
+    }
+
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -3192,33 +3372,31 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // Initialize zerocoin supply to the supply from previous block
     if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3) {
-        for (auto& denom : zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->mapZerocoinSupply.at(denom);
-        }
+        pindex->SetZerocoinSupply(*pindex->pprev);
     }
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->ClearMints();
     if (pindex->pprev) {
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->AddMint(denom);
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) + 1);
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) - 1);
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
-            if (pindex->mapZerocoinSupply.at(denom) < 0)
+            if (pindex->GetZerocoinSupply(denom) < 0)
                 return state.DoS(100, error("Block contains zerocoins that spend more than are in the available supply to spend"));
         }
     }
 
     for (auto& denom : zerocoinDenomList) {
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->GetZerocoinSupply(denom));
     }
 
     // track money supply and mint amount info
@@ -3341,6 +3519,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (pindex->nHeight >= Params().Zerocoin_Block_FirstFraudulent() && pindex->nHeight <= Params().Zerocoin_Block_RecalculateAccumulators() + 1)
         AddInvalidSpendsToMap(block);
 
+    //Keep the mints of this block in memory for the accumulator checkpoints that will include them,
+    //and in the mint index for witnesses
+    if (pindex->nHeight >= Params().Zerocoin_StartHeight()) {
+        CachePubcoins(block, pindex);
+        if (!IndexBlockMints(block, pindex))
+            LogPrintf("%s : failed to index zerocoin mints of block %d\n", __func__, pindex->nHeight);
+    }
+
     return true;
 }
 
@@ -3938,6 +4124,36 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/** Set the stake fields of a block index entry, which need its block and its parent's stake modifier */
+static void SetBlockStakeState(CBlockIndex* pindexNew)
+{
+    uint256 hash = pindexNew->GetBlockHash();
+
+    // ppcoin: compute chain trust score
+    pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
+
+    // ppcoin: compute stake entropy bit for stake modifier
+    if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
+        LogPrintf("SetBlockStakeState() : SetStakeEntropyBit() failed \n");
+
+    // ppcoin: record proof-of-stake hash value
+    if (pindexNew->IsProofOfStake()) {
+        if (!mapProofOfStake.count(hash))
+            LogPrintf("SetBlockStakeState() : hashProofOfStake not found in map \n");
+        pindexNew->hashProofOfStake = mapProofOfStake[hash];
+    }
+
+    // ppcoin: compute stake modifier
+    uint64_t nStakeModifier = 0;
+    bool fGeneratedStakeModifier = false;
+    if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
+        LogPrintf("SetBlockStakeState() : ComputeNextStakeModifier() failed \n");
+    pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+    pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+    if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+        LogPrintf("SetBlockStakeState() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -3969,33 +4185,15 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
-        // ppcoin: compute stake entropy bit for stake modifier
-        if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
-            LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
-
-        // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
-                LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
-        }
-
-        // ppcoin: compute stake modifier
-        uint64_t nStakeModifier = 0;
-        bool fGeneratedStakeModifier = false;
-        if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
-            LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
-        pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
-        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
-        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
-            LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
+        // a header carries no coinstake, and a block after one has no stake modifier to build on yet
+        if (block.vtx.empty() || (pindexNew->pprev->nStatus & BLOCK_STAKE_UNCHECKED))
+            pindexNew->nStatus |= BLOCK_STAKE_UNCHECKED;
+        else
+            SetBlockStakeState(pindexNew);
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (IsHeaderWorkTrusted(pindexNew) && (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork))
         pindexBestHeader = pindexNew;
 
     //update previous block pointer
@@ -4010,8 +4208,15 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const CDiskBlockPos& pos)
 {
-    if (block.IsProofOfStake())
+    if (block.IsProofOfStake()) {
         pindexNew->SetProofOfStake();
+        // the index entry was made from the header alone
+        if (pindexNew->prevoutStake.IsNull()) {
+            pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+            pindexNew->nStakeTime = block.nTime;
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        }
+    }
     pindexNew->nTx = block.vtx.size();
     pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
@@ -4276,9 +4481,20 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check transactions
     bool fZerocoinActive = block.GetBlockTime() > Params().Zerocoin_StartTime();
     vector<CBigNum> vBlockSerials;
+
+    // Zerocoin spend proofs are verified concurrently on the spend check threads when the queue is free
+    TRY_LOCK(cs_zerocoinspendcheckqueue, lockSpendCheckQueue);
+    bool fSpendCheckQueue = lockSpendCheckQueue && nScriptCheckThreads;
+    CCheckQueueControl<CZerocoinSpendCheck> control(fSpendCheckQueue ? &zerocoinspendcheckqueue : NULL);
+
+    unsigned int nSpendChecks = 0;
+    int64_t nTimeSpendCheckStart = GetTimeMicros();
     for (const CTransaction& tx : block.vtx) {
-        if (!CheckTransaction(tx, fZerocoinActive, chainActive.Height() + 1 >= Params().Zerocoin_Block_EnforceSerialRange(), state))
+        std::vector<CZerocoinSpendCheck> vSpendChecks;
+        if (!CheckTransaction(tx, fZerocoinActive, chainActive.Height() + 1 >= Params().Zerocoin_Block_EnforceSerialRange(), state, fSpendCheckQueue ? &vSpendChecks : NULL))
             return error("CheckBlock() : CheckTransaction failed");
+        nSpendChecks += vSpendChecks.size();
+        control.Add(vSpendChecks);
 
         // double check that there are no double spent zWgr spends in this block
         if (tx.IsZerocoinSpend()) {
@@ -4304,10 +4520,16 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
             REJECT_INVALID, "bad-blk-sigops", true);
 
+    if (!control.Wait())
+        return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"),
+            REJECT_INVALID, "bad-zerocoinspend");
+    if (nSpendChecks)
+        LogPrint("bench", "    - Verify %u zerocoin spend proofs: %.2fms\n", nSpendChecks, 0.001 * (GetTimeMicros() - nTimeSpendCheckStart));
+
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev, bool fCheckKernel)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().ToString().c_str());
@@ -4327,7 +4549,7 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     if (block.nBits != nBitsRequired)
         return error("%s : incorrect proof of work at %d", __func__, pindexPrev->nHeight + 1);
 
-    if (block.IsProofOfStake()) {
+    if (block.IsProofOfStake() && fCheckKernel) {
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
 
@@ -4365,6 +4587,22 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
             REJECT_INVALID, "time-too-old");
     }
 
+    // Headers are accepted ahead of their blocks, and a staked header cannot be checked against
+    // its kernel without the staked output: hold it to what the header chain alone determines.
+    bool fProofOfStake = nHeight > Params().LAST_POW_BLOCK();
+    if (!fProofOfStake && !CheckProofOfWork(hash, block.nBits))
+        return state.DoS(50, error("%s : proof of work failed at %d", __func__, nHeight),
+            REJECT_INVALID, "high-hash");
+
+    // DGW pre-fork blocks are only held to an approximate difficulty, see CheckWork()
+    if ((fProofOfStake || nHeight > 1001) && block.nBits != GetNextWorkRequired(pindexPrev, &block))
+        return state.DoS(100, error("%s : incorrect difficulty at %d", __func__, nHeight),
+            REJECT_INVALID, "bad-diffbits");
+
+    if (block.GetBlockTime() > GetAdjustedTime() + (fProofOfStake ? 180 : 7200))
+        return state.Invalid(error("%s : block timestamp too far in the future", __func__),
+            REJECT_INVALID, "time-too-new");
+
     // Check that the block chain matches the known block chain up to a checkpoint
     if (!Checkpoints::CheckBlock(nHeight, hash))
         return state.DoS(100, error("%s : rejected by checkpoint lock-in at %d", __func__, nHeight),
@@ -4525,7 +4763,16 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         }
     }
 
-    if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
+    // The kernel needs the staked output and the stake modifiers, which are known once the parent is
+    // on the active chain. A staked block downloaded ahead of that is only taken unchecked when its
+    // header leads to a checkpoint, and ConnectBlock() checks its kernel.
+    bool fCheckKernel = true;
+    if (pindexPrev && !chainActive.Contains(pindexPrev) && block.IsProofOfStake()) {
+        BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
+        if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_STAKE_UNCHECKED) && IsHeaderWorkTrusted(mi->second))
+            fCheckKernel = false;
+    }
+    if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev, fCheckKernel))
         return false;
 
     if (!AcceptBlockHeader(block, state, &pindex))
@@ -4665,7 +4912,8 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
-            pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
+            LOCK(cs_main);
+            PushGetBlocks(pfrom, uint256(0));
             return false;
         }
     }
@@ -4693,6 +4941,8 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         return error("%s : ActivateBestChain failed", __func__);
 
     if (!fLiteMode) {
+        // the masternode message handlers may be running on a worker thread
+        LOCK(cs_masternodeMessages);
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
             obfuScationPool.NewBlock();
             masternodePayments.ProcessBlock(GetHeight() + 10);
@@ -4828,7 +5078,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(string& strError)
 {
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(std::max(nScriptCheckThreads, 1)))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4862,9 +5112,15 @@ bool static LoadBlockIndexDB(string& strError)
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
-        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+        if (pindex->IsValid(BLOCK_VALID_TREE) && (!(pindex->nStatus & BLOCK_STAKE_UNCHECKED) || pindex->nHeight <= Params().LAST_POW_BLOCK()) &&
+            (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    // Staked header-only entries count once they lead to a checkpoint, see IsHeaderWorkTrusted()
+    CBlockIndex* pindexCheckpoint = Checkpoints::GetLastCheckpoint();
+    if (pindexCheckpoint && pindexCheckpoint->IsValid(BLOCK_VALID_TREE) &&
+        (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindexCheckpoint)))
+        pindexBestHeader = pindexCheckpoint;
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -5442,9 +5698,108 @@ string GetWarnings(string strFor)
 // Messages
 //
 
+/** The protocol message commands we know, with the class each is processed in */
+static const struct {
+    const char* pszCommand;
+    MessageClass messageClass;
+} messageCommands[] = {
+    {"version", MSG_CLASS_CHAIN}, {"verack", MSG_CLASS_CHAIN}, {"addr", MSG_CLASS_CHAIN},
+    {"inv", MSG_CLASS_CHAIN}, {"getdata", MSG_CLASS_CHAIN}, {"getblocks", MSG_CLASS_CHAIN},
+    {"getheaders", MSG_CLASS_CHAIN}, {"headers", MSG_CLASS_CHAIN}, {"tx", MSG_CLASS_CHAIN},
+    {"dstx", MSG_CLASS_CHAIN}, {"block", MSG_CLASS_CHAIN}, {"getaddr", MSG_CLASS_CHAIN},
+    {"mempool", MSG_CLASS_CHAIN}, {"ping", MSG_CLASS_CHAIN}, {"pong", MSG_CLASS_CHAIN},
+    {"alert", MSG_CLASS_CHAIN}, {"filterload", MSG_CLASS_CHAIN}, {"filteradd", MSG_CLASS_CHAIN},
+    {"filterclear", MSG_CLASS_CHAIN}, {"reject", MSG_CLASS_CHAIN}, {"notfound", MSG_CLASS_CHAIN},
+    // sporks are read by every other handler, and obfuscation works on the mempool
+    {"spork", MSG_CLASS_CHAIN}, {"getsporks", MSG_CLASS_CHAIN}, {"dsa", MSG_CLASS_CHAIN},
+    {"dsc", MSG_CLASS_CHAIN}, {"dsf", MSG_CLASS_CHAIN}, {"dsi", MSG_CLASS_CHAIN},
+    {"dsq", MSG_CLASS_CHAIN}, {"dss", MSG_CLASS_CHAIN}, {"dssu", MSG_CLASS_CHAIN},
+    {"mnb", MSG_CLASS_MASTERNODE}, {"mnp", MSG_CLASS_MASTERNODE}, {"dseg", MSG_CLASS_MASTERNODE},
+    {"dsee", MSG_CLASS_MASTERNODE}, {"dseep", MSG_CLASS_MASTERNODE}, {"mnget", MSG_CLASS_MASTERNODE},
+    {"mnw", MSG_CLASS_MASTERNODE}, {"mnvs", MSG_CLASS_MASTERNODE}, {"mprop", MSG_CLASS_MASTERNODE},
+    {"mvote", MSG_CLASS_MASTERNODE}, {"fbs", MSG_CLASS_MASTERNODE}, {"fbvote", MSG_CLASS_MASTERNODE},
+    {"ssc", MSG_CLASS_MASTERNODE},
+    {"ix", MSG_CLASS_SWIFTTX}, {"txlvote", MSG_CLASS_SWIFTTX},
+};
+
+static int FindMessageCommand(const std::string& strCommand)
+{
+    for (unsigned int i = 0; i < ARRAYLEN(messageCommands); i++)
+        if (strCommand == messageCommands[i].pszCommand)
+            return i;
+    return -1;
+}
+
+MessageClass GetMessageClass(const std::string& strCommand)
+{
+    int nCommand = FindMessageCommand(strCommand);
+    return nCommand < 0 ? MSG_CLASS_CHAIN : messageCommands[nCommand].messageClass;
+}
+
+/**
+ * Held while a message of the class is processed, one message of a class at a time. The main
+ * message handler try-locks cs_masternodeMessages to read what the masternode handlers update,
+ * and comes back to the read later if a worker holds it.
+ */
+static CCriticalSection cs_chainMessages;
+
+/** Set by the main message handler when it left a getdata request to a worker holding cs_masternodeMessages */
+static std::atomic<bool> fMasternodeGetDataDeferred(false);
+
+static CCriticalSection& MessageClassLock(MessageClass messageClass)
+{
+    switch (messageClass) {
+    case MSG_CLASS_MASTERNODE:
+        return cs_masternodeMessages;
+    case MSG_CLASS_SWIFTTX:
+        // the SwiftX maps are read under cs_main in block and transaction validation
+        return cs_main;
+    default:
+        return cs_chainMessages;
+    }
+}
+
+/** Inventory items kept in the maps of the masternode class of messages */
+static bool IsMasternodeInv(const CInv& inv)
+{
+    switch (inv.type) {
+    case MSG_MASTERNODE_WINNER:
+    case MSG_BUDGET_VOTE:
+    case MSG_BUDGET_PROPOSAL:
+    case MSG_BUDGET_FINALIZED:
+    case MSG_BUDGET_FINALIZED_VOTE:
+    case MSG_MASTERNODE_ANNOUNCE:
+    case MSG_MASTERNODE_PING:
+        return true;
+    }
+    return false;
+}
+
+static CCriticalSection cs_messageStats;
+static std::map<std::string, CMessageStats> mapMessageStats;
+
+static void UpdateMessageStats(const std::string& strCommand, int64_t nWaitTime, int64_t nTime)
+{
+    LOCK(cs_messageStats);
+    CMessageStats& stats = mapMessageStats[FindMessageCommand(strCommand) < 0 ? "other" : strCommand];
+    stats.nCount++;
+    stats.nTotalTime += nTime;
+    stats.nMaxTime = std::max(stats.nMaxTime, nTime);
+    stats.nTotalWaitTime += nWaitTime;
+}
+
+void GetMessageStats(std::map<std::string, CMessageStats>& mapStatsRet)
+{
+    LOCK(cs_messageStats);
+    mapStatsRet = mapMessageStats;
+}
+
 
 bool static AlreadyHave(const CInv& inv)
 {
+    // While a worker updates the masternode maps, ask for their items anyway: the handlers drop the ones seen
+    TRY_LOCK(cs_masternodeMessages, lockMasternode);
+
     switch (inv.type) {
     case MSG_TX: {
         bool txInMap = false;
@@ -5464,42 +5819,56 @@ bool static AlreadyHave(const CInv& inv)
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
+        if (!lockMasternode)
+            return false;
         if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
         return false;
     case MSG_BUDGET_VOTE:
+        if (!lockMasternode)
+            return false;
         if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
             masternodeSync.AddedBudgetItem(inv.hash);
             return true;
         }
         return false;
     case MSG_BUDGET_PROPOSAL:
+        if (!lockMasternode)
+            return false;
         if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
             masternodeSync.AddedBudgetItem(inv.hash);
             return true;
         }
         return false;
     case MSG_BUDGET_FINALIZED_VOTE:
+        if (!lockMasternode)
+            return false;
         if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
             masternodeSync.AddedBudgetItem(inv.hash);
             return true;
         }
         return false;
     case MSG_BUDGET_FINALIZED:
+        if (!lockMasternode)
+            return false;
         if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
             masternodeSync.AddedBudgetItem(inv.hash);
             return true;
         }
         return false;
     case MSG_MASTERNODE_ANNOUNCE:
+        if (!lockMasternode)
+            return false;
         if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
             masternodeSync.AddedMasternodeList(inv.hash);
             return true;
         }
         return false;
     case MSG_MASTERNODE_PING:
+        if (!lockMasternode)
+            return false;
         return mnodeman.mapSeenMasternodePing.count(inv.hash);
     }
     // Don't know what it is, just say we already got one
@@ -5507,224 +5876,256 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
-void static ProcessGetData(CNode* pfrom)
+/** Answer the queued getdata requests of a node; false if the rest waits for a worker holding cs_masternodeMessages */
+bool static ProcessGetData(CNode* pfrom)
 {
+    bool fDeferred = false;
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
+    // A block is sent as it is stored in its block file, after cs_main is released
+    CDiskBlockPos posBlock;
+    uint256 hashBlock;
+    uint256 hashContinueTip = 0;
 
-    while (it != pfrom->vRecvGetData.end()) {
-        // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
-            break;
+    {
+        // The masternode maps are read under the lock their worker updates them with
+        TRY_LOCK(cs_masternodeMessages, lockMasternode);
+        LOCK(cs_main);
 
-        const CInv& inv = *it;
-        {
-            boost::this_thread::interruption_point();
-            it++;
-
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end()) {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a max reorg depth than the best header
-                        // chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                               (chainActive.Height() - mi->second->nHeight < Params().MaxReorganizationDepth());
-                        if (!send) {
-                            LogPrintf("ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
+        while (it != pfrom->vRecvGetData.end()) {
+            // Don't bother if send buffer is too full to respond anyway
+            if (pfrom->nSendSize >= SendBufferSize())
+                break;
+
+            const CInv& inv = *it;
+
+            // Answer the rest, in order, once the worker is done
+            if (!lockMasternode && IsMasternodeInv(inv)) {
+                fMasternodeGetDataDeferred = true;
+                fDeferred = true;
+                break;
+            }
+            {
+                boost::this_thread::interruption_point();
+                it++;
+
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+                    bool send = false;
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end()) {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a max reorg depth than the best header
+                            // chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                                   (chainActive.Height() - mi->second->nHeight < Params().MaxReorganizationDepth());
+                            if (!send) {
+                                LogPrintf("ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
+                            }
                         }
                     }
-                }
-                // Don't send not-validated blocks
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
-                    {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter) {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage("merkleblock", merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didnt send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH (PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                    // Don't send not-validated blocks
+                    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                        if (inv.type == MSG_BLOCK) {
+                            posBlock = mi->second->GetBlockPos();
+                            hashBlock = inv.hash;
+                        } else // MSG_FILTERED_BLOCK)
+                        {
+                            // Send block from disk
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter) {
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                                pfrom->PushMessage("merkleblock", merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didnt send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH (PairType& pair, merkleBlock.vMatchedTxn)
+                                    if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                        pfrom->PushMessage("tx", block.vtx[pair.first]);
+                            }
+                            // else
+                            // no response
                         }
-                        // else
-                        // no response
-                    }
 
-                    // Trigger them to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue) {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue = 0;
+                        // Trigger them to send a getblocks request for the next batch of inventory
+                        if (inv.hash == pfrom->hashContinue) {
+                            hashContinueTip = chainActive.Tip()->GetBlockHash();
+                            pfrom->hashContinue = 0;
+                        }
                     }
-                }
-            } else if (inv.IsKnownType()) {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
+                } else if (inv.IsKnownType()) {
+                    // Send stream from relay memory
+                    bool pushed = false;
+                    {
+                        LOCK(cs_mapRelay);
+                        map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                        if (mi != mapRelay.end()) {
+                            pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TX) {
+                        CTransaction tx;
+                        if (mempool.lookup(inv.hash, tx)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << tx;
+                            pfrom->PushMessage("tx", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
+                        if (mapTxLockVote.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapTxLockVote[inv.hash];
+                            pfrom->PushMessage("txlvote", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
+                        if (mapTxLockReq.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapTxLockReq[inv.hash];
+                            pfrom->PushMessage("ix", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_SPORK) {
+                        if (mapSporks.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapSporks[inv.hash];
+                            pfrom->PushMessage("spork", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
+                        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+                            pfrom->PushMessage("mnw", ss);
+                            pushed = true;
+                        }
                     }
-                }
-                if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-                    if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_VOTE) {
+                        if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
+                            pfrom->PushMessage("mvote", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-                    if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
+                        if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
+                            pfrom->PushMessage("mprop", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-                    if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
+                        if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
+                            pfrom->PushMessage("fbvote", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-                    if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
+                        if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << budget.mapSeenFinalizedBudgets[inv.hash];
+                            pfrom->PushMessage("fbs", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
+                        if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
+                            pfrom->PushMessage("mnb", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_MASTERNODE_PING) {
+                        if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodePing[inv.hash];
+                            pfrom->PushMessage("mnp", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
-                if (!pushed && inv.type == MSG_DSTX) {
-                    if (mapObfuscationBroadcastTxes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
+                    if (!pushed && inv.type == MSG_DSTX) {
+                        if (mapObfuscationBroadcastTxes.count(inv.hash)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
 
-                        pfrom->PushMessage("dstx", ss);
-                        pushed = true;
+                            pfrom->PushMessage("dstx", ss);
+                            pushed = true;
+                        }
                     }
-                }
 
 
-                if (!pushed) {
-                    vNotFound.push_back(inv);
+                    if (!pushed) {
+                        vNotFound.push_back(inv);
+                    }
                 }
-            }
 
-            // Track requests for our stuff.
-            GetMainSignals().Inventory(inv.hash);
+                // Track requests for our stuff.
+                GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
-                break;
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+                    break;
+            }
         }
     }
 
+    if (!posBlock.IsNull()) {
+        // Block files are only ever appended to, so the block can be read without cs_main,
+        // and its disk serialization is pushed as is
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        if (!ReadRawBlockFromDisk(ssBlock, posBlock, hashBlock))
+            assert(!"cannot load block from disk");
+        pfrom->PushMessage("block", ssBlock);
+    }
+
+    if (hashContinueTip != 0) {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
+        pfrom->PushMessage("inv", vInv);
+    }
+
     pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
 
     if (!vNotFound.empty()) {
@@ -5737,6 +6138,8 @@ void static ProcessGetData(CNode* pfrom)
         // having to download the entire memory pool.
         pfrom->PushMessage("notfound", vNotFound);
     }
+
+    return !fDeferred;
 }
 
 bool fRequestedSporksIDB = false;
@@ -5977,9 +6380,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    if (IsHeadersFirstPeer(pfrom)) {
+                        // Request the headers leading to the announced block; the block itself is fetched
+                        // with the download window, or right away if we are close to the tip.
+                        PushGetHeaders(pfrom, pindexBestHeader, inv.hash);
+                        if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().TargetSpacing() * 20) {
+                            vToFetch.push_back(inv);
+                            MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                        }
+                        LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(inv);
+                        LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
                 }
             }
 
@@ -6016,7 +6430,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks" || (strCommand == "getheaders" && pfrom->nVersion < HEADERS_FIRST_VERSION)) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -6048,7 +6462,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -6262,6 +6676,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         LOCK(cs_main);
 
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (nodestate->nHeadersRequested == 0) {
+            Misbehaving(pfrom->GetId(), 20);
+            return error("unrequested headers from peer=%d", pfrom->id);
+        }
+        nodestate->nHeadersRequested--;
+
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
@@ -6274,10 +6695,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+            // Staked headers cost nothing to make, so they are not taken too far ahead of the active chain
+            BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+            if (mi != mapBlockIndex.end() && mi->second->nHeight >= Params().LAST_POW_BLOCK() &&
+                mi->second->nHeight >= chainActive.Height() + MAX_STAKE_HEADERS_AHEAD) {
+                LogPrint("net", "pausing headers sync at %d with peer=%d\n", mi->second->nHeight, pfrom->id);
+                nodestate->fHeadersPaused = true;
+                break;
+            }
+
+            // a block without transactions, AddToBlockIndex() knows it is a header
+            if (!AcceptBlockHeader(CBlock(header), state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -6291,12 +6719,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !nodestate->fHeadersPaused) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
             LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256(0));
+            PushGetHeaders(pfrom, pindexLast, uint256(0));
         }
 
         CheckBlockIndex();
@@ -6312,20 +6740,23 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
         if (!mapBlockIndex.count(block.hashPrevBlock)) {
+            LOCK(cs_main);
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
+                PushGetBlocks(pfrom, block.hashPrevBlock);
                 pfrom->vBlockRequested.push_back(block.hashPrevBlock);
             } else {
                 //ask to sync to this block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
+                PushGetBlocks(pfrom, hashBlock);
                 pfrom->vBlockRequested.push_back(hashBlock);
             }
         } else {
             pfrom->AddInventoryKnown(inv);
 
             CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
+            //with headers-first sync, the header is usually known before the block arrives
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
                 ProcessNewBlock(state, pfrom, &block);
                 int nDoS;
                 if(state.IsInvalid(nDoS)) {
@@ -6594,8 +7025,44 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+/**
+ * Whether this thread processes the next message of a peer. Until the version handshake is done
+ * everything goes to the main message handler, which handles it all when there are no workers.
+ */
+static bool IsMessageForThread(const CNode* pfrom, MessageClass messageClass, bool fWorker)
+{
+    if (messageClass == MSG_CLASS_CHAIN || pfrom->nVersion == 0)
+        return !fWorker;
+    return fWorker == (nMessageHandlerWorkers > 0);
+}
+
+/**
+ * Queue the signature checks of a peer's received masternode, budget and SwiftX messages, so
+ * they are done on the signature check threads while the messages wait. When the queue is full
+ * the rest are left to be checked by the message handler.
+ */
+static void QueueSignatureChecks(CNode* pfrom)
+{
+    BOOST_FOREACH (CNetMessage& msg, pfrom->vRecvMsg) {
+        if (!msg.complete())
+            break;
+        if (msg.fSigCheckQueued)
+            continue;
+
+        string strCommand = msg.hdr.GetCommand();
+        MessageClass messageClass = GetMessageClass(strCommand);
+        if (messageClass != MSG_CLASS_CHAIN) {
+            // messages already processed are only skipped when nothing is processing them
+            CCriticalBlock lockSeen(MessageClassLock(messageClass), "cs_messageclass", __FILE__, __LINE__, true);
+            if (!QueueMasternodeSigCheck(strCommand, msg.vRecv, lockSeen))
+                break;
+        }
+        msg.fSigCheckQueued = true;
+    }
+}
+
 // requires LOCK(cs_vRecvMsg)
-bool ProcessMessages(CNode* pfrom)
+bool ProcessMessages(CNode* pfrom, bool fWorker, bool& fMoreWork)
 {
     //if (fDebug)
     //    LogPrintf("ProcessMessages(%u messages)\n", pfrom->vRecvMsg.size());
@@ -6609,12 +7076,29 @@ bool ProcessMessages(CNode* pfrom)
     //  (x) data
     //
     bool fOk = true;
+    bool fClassBusy = false;
+    bool fProcessed = false;
+    bool fGetDataDeferred = false;
+    fMoreWork = false;
 
-    if (!pfrom->vRecvGetData.empty())
-        ProcessGetData(pfrom);
+    // the thread processing a peer's masternode messages queues their signature checks
+    if (nMasternodeSigCheckThreads > 0 && pfrom->nVersion != 0 && IsMessageForThread(pfrom, MSG_CLASS_MASTERNODE, fWorker))
+        QueueSignatureChecks(pfrom);
+
+    // getdata requests are answered by the main message handler, before the messages after them
+    if (!pfrom->vRecvGetData.empty()) {
+        if (fWorker)
+            return fOk;
+        fGetDataDeferred = !ProcessGetData(pfrom);
+        fProcessed = true;
+    }
 
     // this maintains the order of responses
-    if (!pfrom->vRecvGetData.empty()) return fOk;
+    if (!pfrom->vRecvGetData.empty()) {
+        // the worker holding the masternode maps wakes us when it is done with them
+        fMoreWork = !fGetDataDeferred && pfrom->nSendSize < SendBufferSize();
+        return fOk;
+    }
 
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
@@ -6634,6 +7118,21 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // Leave the message to the thread of its class: the messages after it wait for it, which
+        // keeps each peer's messages in order
+        MessageClass messageClass = GetMessageClass(msg.hdr.GetCommand());
+        if (!IsMessageForThread(pfrom, messageClass, fWorker))
+            break;
+
+        // Workers only try the class lock, so they do not queue behind another thread to start a
+        // message. They can still wait on cs_main inside the masternode and budget handlers, which
+        // take it to look up collateral transactions and blocks.
+        CCriticalBlock lockClass(MessageClassLock(messageClass), "cs_messageclass", __FILE__, __LINE__, fWorker);
+        if (!lockClass) {
+            fClassBusy = true;
+            break;
+        }
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -6668,6 +7167,7 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nStart = GetTimeMicros();
         try {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
             boost::this_thread::interruption_point();
@@ -6689,6 +7189,8 @@ bool ProcessMessages(CNode* pfrom)
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        UpdateMessageStats(strCommand, nStart - msg.nTime, GetTimeMicros() - nStart);
+        fProcessed = true;
 
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -6697,9 +7199,25 @@ bool ProcessMessages(CNode* pfrom)
     }
 
     // In case the connection got shut down, its receive buffer was wiped
-    if (!pfrom->fDisconnect)
+    if (!pfrom->fDisconnect) {
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
 
+        if (pfrom->nSendSize < SendBufferSize()) {
+            if (!pfrom->vRecvGetData.empty())
+                fMoreWork = !fWorker;
+            else if (!pfrom->vRecvMsg.empty() && pfrom->vRecvMsg[0].complete()) {
+                if (IsMessageForThread(pfrom, GetMessageClass(pfrom->vRecvMsg[0].hdr.GetCommand()), fWorker))
+                    fMoreWork = !fClassBusy;
+                else if (fProcessed)
+                    WakeMessageHandlers(); // the thread it is for may have passed this node while we held it
+            }
+        }
+    }
+
+    // getdata requests the main message handler left while this worker held the masternode maps
+    if (fWorker && fProcessed && fMasternodeGetDataDeferred.exchange(false))
+        WakeMessageHandlers();
+
     return fOk;
 }
 
@@ -6810,10 +7328,23 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                if (IsHeadersFirstPeer(pto)) {
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    PushGetHeaders(pto, pindexStart, uint256(0));
+                } else {
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                }
+            }
+        }
+
+        // Resume headers sync once the active chain has caught up with the headers we have from this peer
+        if (state.fHeadersPaused) {
+            CBlockIndex* pindexStart = state.pindexBestKnownBlock ? state.pindexBestKnownBlock : pindexBestHeader;
+            if (pindexStart->nHeight < chainActive.Height() + MAX_STAKE_HEADERS_AHEAD / 2) {
+                state.fHeadersPaused = false;
+                LogPrint("net", "resuming headers sync (%d) with peer=%d\n", pindexStart->nHeight, pto->id);
+                PushGetHeaders(pto, pindexStart, uint256(0));
             }
         }
 
@@ -42,6 +42,7 @@
 
 #include "libzerocoin/CoinSpend.h"
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
@@ -51,6 +52,7 @@ class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -77,6 +79,14 @@ static const unsigned int MAX_TX_SIGOPS_CURRENT = MAX_BLOCK_SIGOPS_CURRENT / 5;
 static const unsigned int MAX_TX_SIGOPS_LEGACY = MAX_BLOCK_SIGOPS_LEGACY / 5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -limitancestorcount, max number of in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -limitancestorsize, maximum kilobytes of tx + all in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
+/** Default for -limitdescendantcount, max number of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+/** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -103,6 +113,8 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** How far ahead of the active chain headers of staked blocks are accepted, as they take no work to make. */
+static const int MAX_STAKE_HEADERS_AHEAD = 4 * BLOCK_DOWNLOAD_WINDOW;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
@@ -211,8 +223,34 @@ bool LoadBlockIndex(std::string& strError);
 void UnloadBlockIndex();
 /** See whether the protocol update is enforced for connected nodes */
 int ActiveProtocol();
-/** Process protocol messages received from a given node */
-bool ProcessMessages(CNode* pfrom);
+/** Classes of protocol messages, by the state their handlers work on */
+enum MessageClass {
+    MSG_CLASS_CHAIN,      //! blocks, transactions, peer state and anything unknown: main message handler only
+    MSG_CLASS_MASTERNODE, //! masternode list, payments, budget and sync status
+    MSG_CLASS_SWIFTTX,    //! SwiftX lock requests and votes, processed under cs_main
+};
+/** The class of a protocol message command */
+MessageClass GetMessageClass(const std::string& strCommand);
+/**
+ * Process protocol messages received from a given node, in the order they were received. Workers
+ * only process masternode and SwiftX messages, the main message handler everything else.
+ *
+ * @param[in]   pfrom       The node to process messages from, with its cs_vRecvMsg held.
+ * @param[in]   fWorker     Whether this is a worker thread rather than the main message handler.
+ * @param[out]  fMoreWork   Set when this thread could process more of the node's messages right away.
+ */
+bool ProcessMessages(CNode* pfrom, bool fWorker, bool& fMoreWork);
+
+/** Processing statistics of one protocol message command */
+struct CMessageStats {
+    uint64_t nCount;
+    int64_t nTotalTime;     //! microseconds spent processing
+    int64_t nMaxTime;
+    int64_t nTotalWaitTime; //! microseconds from receipt until processing started
+    CMessageStats() : nCount(0), nTotalTime(0), nMaxTime(0), nTotalWaitTime(0) {}
+};
+/** Per-command statistics of the messages processed so far, commands we do not know under "other" */
+void GetMessageStats(std::map<std::string, CMessageStats>& mapStatsRet);
 /**
  * Send queued protocol messages to be sent to a give node.
  *
@@ -222,6 +260,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinSpendCheck();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -353,9 +393,13 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state);
+/**
+ * Check the zerocoin spends of a transaction. If pvChecks is not NULL, the proofs of each spend are
+ * pushed onto it instead of being verified inline.
+ */
+bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvChecks = NULL);
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 bool BlockToPubcoinList(const CBlock& block, list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
@@ -447,11 +491,48 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the verification of one of the three sub-proofs of a zerocoin spend.
+ * The spend and the accumulator it is checked against are shared by the checks of that spend.
+ */
+class CZerocoinSpendCheck
+{
+public:
+    enum ProofType {
+        COMMITMENT_POK,
+        ACCUMULATOR_POK,
+        SERIAL_SOK
+    };
+
+private:
+    boost::shared_ptr<const libzerocoin::CoinSpend> pspend;
+    boost::shared_ptr<const libzerocoin::Accumulator> paccumulator;
+    ProofType proof;
+    uint256 hashTx;
+
+public:
+    CZerocoinSpendCheck() : proof(COMMITMENT_POK), hashTx(0) {}
+    CZerocoinSpendCheck(const boost::shared_ptr<const libzerocoin::CoinSpend>& pspendIn, const boost::shared_ptr<const libzerocoin::Accumulator>& paccumulatorIn,
+                        ProofType proofIn, const uint256& hashTxIn) : pspend(pspendIn), paccumulator(paccumulatorIn), proof(proofIn), hashTx(hashTxIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        pspend.swap(check.pspend);
+        paccumulator.swap(check.paccumulator);
+        std::swap(proof, check.proof);
+        std::swap(hashTx, check.hashTx);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read a block as it is serialized on disk, which is also its network serialization */
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CDiskBlockPos& pos, const uint256& hash);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -471,7 +552,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
+bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev, bool fCheckKernel = true);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -482,7 +563,7 @@ bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex
 
 /** Store block on disk. If dbp is provided, the file is known to already reside on disk */
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** pindex, CDiskBlockPos* dbp = NULL, bool fAlreadyCheckedBlock = false);
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex = NULL);
+bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex = NULL);
 
 
 class CBlockFileInfo
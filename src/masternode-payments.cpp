@@ -759,15 +759,16 @@ void CMasternodePaymentWinner::Relay()
 
 bool CMasternodePaymentWinner::SignatureValid()
 {
-    CMasternode* pmn = mnodeman.Find(vinMasternode);
+    CPubKey pubKeyMasternode;
+    int protocolVersion;
 
-    if (pmn != NULL) {
+    if (mnodeman.GetMasternodeKey(vinMasternode, pubKeyMasternode, protocolVersion)) {
         std::string strMessage = vinMasternode.prevout.ToStringShort() +
                                  boost::lexical_cast<std::string>(nBlockHeight) +
                                  payee.ToString();
 
         std::string errorMessage = "";
-        if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
+        if (!obfuScationSigner.VerifyMessage(pubKeyMasternode, vchSig, strMessage, errorMessage)) {
             return error("CMasternodePaymentWinner::SignatureValid() - Got bad Masternode address signature %s\n", vinMasternode.prevout.hash.ToString());
         }
 
@@ -0,0 +1,185 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sigcheck.h"
+
+#include "main.h"
+#include "masternode-budget.h"
+#include "masternode-payments.h"
+#include "masternode.h"
+#include "masternodeman.h"
+#include "swifttx.h"
+#include "util.h"
+
+#include <deque>
+#include <set>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+int nMasternodeSigCheckThreads = 0;
+
+namespace
+{
+/** A queued signature check */
+class CMasternodeSigCheck
+{
+public:
+    uint256 hash;
+
+    virtual ~CMasternodeSigCheck() {}
+    virtual void operator()() = 0;
+};
+
+/** Checks the signature of a message; the result is kept by the signature cache */
+template <typename T>
+class CMessageSigCheck : public CMasternodeSigCheck
+{
+public:
+    T msg;
+
+    void operator()();
+};
+
+template <>
+void CMessageSigCheck<CMasternodeBroadcast>::operator()()
+{
+    msg.VerifySignature();
+}
+
+template <>
+void CMessageSigCheck<CMasternodePing>::operator()()
+{
+    // the list may change under us, so check against a copy of the key
+    CPubKey pubKeyMasternode;
+    int protocolVersion;
+    if (!mnodeman.GetMasternodeKey(msg.vin, pubKeyMasternode, protocolVersion)) return;
+    msg.VerifySignature(pubKeyMasternode);
+}
+
+template <>
+void CMessageSigCheck<CMasternodePaymentWinner>::operator()()
+{
+    msg.SignatureValid();
+}
+
+template <>
+void CMessageSigCheck<CBudgetVote>::operator()()
+{
+    msg.SignatureValid(true);
+}
+
+template <>
+void CMessageSigCheck<CFinalizedBudgetVote>::operator()()
+{
+    msg.SignatureValid(true);
+}
+
+template <>
+void CMessageSigCheck<CConsensusVote>::operator()()
+{
+    // the message handler reports votes of unknown masternodes
+    CPubKey pubKeyMasternode;
+    int protocolVersion;
+    if (!mnodeman.GetMasternodeKey(msg.vinMasternode, pubKeyMasternode, protocolVersion)) return;
+    msg.SignatureValid();
+}
+
+boost::mutex mutexSigCheck;
+boost::condition_variable condSigCheck;
+//! checks waiting for a thread
+std::deque<boost::shared_ptr<CMasternodeSigCheck> > queueSigCheck;
+//! hashes of the checks queued or running
+std::set<uint256> setSigCheckInFlight;
+
+/** Read a message to check */
+template <typename T>
+boost::shared_ptr<CMasternodeSigCheck> ReadSigCheck(CDataStream& vRecv)
+{
+    boost::shared_ptr<CMessageSigCheck<T> > check(new CMessageSigCheck<T>());
+    vRecv >> check->msg;
+    check->hash = check->msg.GetHash();
+    return check;
+}
+
+void ThreadMasternodeSigCheck()
+{
+    while (true) {
+        boost::shared_ptr<CMasternodeSigCheck> check;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexSigCheck);
+            while (queueSigCheck.empty())
+                condSigCheck.wait(lock);
+            check = queueSigCheck.front();
+            queueSigCheck.pop_front();
+        }
+
+        (*check)();
+
+        boost::unique_lock<boost::mutex> lock(mutexSigCheck);
+        setSigCheckInFlight.erase(check->hash);
+    }
+}
+} // anon namespace
+
+void StartMasternodeSigChecks(boost::thread_group& threadGroup, int nThreads)
+{
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "mnsigcheck", &ThreadMasternodeSigCheck));
+}
+
+bool QueueMasternodeSigCheck(const std::string& strCommand, const CDataStream& vRecv, bool fCheckSeen)
+{
+    boost::shared_ptr<CMasternodeSigCheck> check;
+    bool fSeen = false;
+    try {
+        CDataStream vMsg(vRecv);
+        // the seen maps are read under the locks they are updated with, and only if those are free
+        if (strCommand == "mnb") {
+            check = ReadSigCheck<CMasternodeBroadcast>(vMsg);
+            fSeen = fCheckSeen && mnodeman.HaveSeenMasternodeBroadcast(check->hash);
+        } else if (strCommand == "mnp") {
+            check = ReadSigCheck<CMasternodePing>(vMsg);
+            fSeen = fCheckSeen && mnodeman.HaveSeenMasternodePing(check->hash);
+        } else if (strCommand == "mnw") {
+            check = ReadSigCheck<CMasternodePaymentWinner>(vMsg);
+            TRY_LOCK(cs_mapMasternodePayeeVotes, lockVotes);
+            fSeen = fCheckSeen && lockVotes && masternodePayments.mapMasternodePayeeVotes.count(check->hash);
+        } else if (strCommand == "mvote") {
+            check = ReadSigCheck<CBudgetVote>(vMsg);
+            TRY_LOCK(cs_budget, lockBudget);
+            fSeen = fCheckSeen && lockBudget && budget.mapSeenMasternodeBudgetVotes.count(check->hash);
+        } else if (strCommand == "fbvote") {
+            check = ReadSigCheck<CFinalizedBudgetVote>(vMsg);
+            TRY_LOCK(cs_budget, lockBudget);
+            fSeen = fCheckSeen && lockBudget && budget.mapSeenFinalizedBudgetVotes.count(check->hash);
+        } else if (strCommand == "txlvote") {
+            check = ReadSigCheck<CConsensusVote>(vMsg);
+            TRY_LOCK(cs_main, lockMain);
+            fSeen = fCheckSeen && lockMain && mapTxLockVote.count(check->hash);
+        }
+    } catch (const std::exception& e) {
+        // the message handler rejects the message
+        return true;
+    }
+
+    if (!check || fSeen)
+        return true;
+
+    boost::unique_lock<boost::mutex> lock(mutexSigCheck);
+    if (setSigCheckInFlight.count(check->hash))
+        return true;
+    if (queueSigCheck.size() >= MAX_MASTERNODE_SIGCHECK_QUEUE)
+        return false;
+    setSigCheckInFlight.insert(check->hash);
+    queueSigCheck.push_back(check);
+    condSigCheck.notify_one();
+    return true;
+}
+
+size_t MasternodeSigChecksPending()
+{
+    boost::unique_lock<boost::mutex> lock(mutexSigCheck);
+    return setSigCheckInFlight.size();
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_SIGCHECK_H
+#define MASTERNODE_SIGCHECK_H
+
+#include <string>
+
+class CDataStream;
+
+namespace boost
+{
+class thread_group;
+} // namespace boost
+
+/** -mnsigthreads default: signatures are checked by the message handler as it processes them */
+static const int DEFAULT_MASTERNODE_SIGCHECK_THREADS = 0;
+/** Maximum number of signature check threads */
+static const int MAX_MASTERNODE_SIGCHECK_THREADS = 8;
+/** Maximum number of signature checks waiting for a thread */
+static const unsigned int MAX_MASTERNODE_SIGCHECK_QUEUE = 10000;
+
+/** Number of signature check threads, 0 checks every signature on the message handler */
+extern int nMasternodeSigCheckThreads;
+
+//
+// Masternode signature checks: the signatures of received masternode, budget and SwiftX
+// messages are checked ahead of time on a pool of threads, while the messages wait for
+// the message handler. A valid signature is kept in the obfuScationSigner signature
+// cache, so the message handler does not recover it again.
+//
+
+/** Start the signature check threads */
+void StartMasternodeSigChecks(boost::thread_group& threadGroup, int nThreads);
+/**
+ * Queue the signature check of a received message, skipping messages that are already
+ * queued and, if fCheckSeen, ones that were already processed. Returns false only if
+ * the queue is full.
+ */
+bool QueueMasternodeSigCheck(const std::string& strCommand, const CDataStream& vRecv, bool fCheckSeen);
+/** Number of signature checks queued or running */
+size_t MasternodeSigChecksPending();
+
+#endif
@@ -62,6 +62,7 @@ public:
 
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
+    bool VerifySignature(const CPubKey& pubKeyMasternode);
     void Relay();
 
     uint256 GetHash()
@@ -300,6 +301,7 @@ public:
     bool CheckAndUpdate(int& nDoS);
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
+    bool VerifySignature();
     void Relay();
 
     ADD_SERIALIZE_METHODS;
@@ -27,19 +27,11 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
+struct CompareScoreIndex {
+    bool operator()(const pair<int64_t, size_t>& t1,
+        const pair<int64_t, size_t>& t2) const
     {
-        return t1.first < t2.first;
-    }
-};
-
-struct CompareScoreMN {
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-        const pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
+        return t1.first > t2.first;
     }
 };
 
@@ -197,6 +189,35 @@ void DumpMasternodes()
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    fIndexesDirty = false;
+}
+
+void CMasternodeMan::AddToIndexes(size_t nIndex)
+{
+    const CMasternode& mn = vMasternodes[nIndex];
+
+    // insert() keeps an existing entry, so each key stays with the first masternode that has it
+    mapIndexByVin.insert(make_pair(mn.vin.prevout, nIndex));
+    mapIndexByPayee.insert(make_pair(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()), nIndex));
+    mapIndexByPubKey.insert(make_pair(mn.pubKeyMasternode, nIndex));
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    mapIndexByVin.clear();
+    mapIndexByPayee.clear();
+    mapIndexByPubKey.clear();
+
+    for (size_t i = 0; i < vMasternodes.size(); i++)
+        AddToIndexes(i);
+
+    fIndexesDirty = false;
+}
+
+void CMasternodeMan::MarkIndexesDirty()
+{
+    LOCK(cs);
+    fIndexesDirty = true;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -210,6 +231,9 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        if (!fIndexesDirty)
+            AddToIndexes(vMasternodes.size() - 1);
+        mapScoresByHeight.clear();
         return true;
     }
 
@@ -280,6 +304,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            fIndexesDirty = true;
+            mapScoresByHeight.clear();
         } else {
             ++it;
         }
@@ -341,6 +367,11 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapIndexByVin.clear();
+    mapIndexByPayee.clear();
+    mapIndexByPubKey.clear();
+    fIndexesDirty = false;
+    mapScoresByHeight.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -439,25 +470,40 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
+    if (fIndexesDirty)
+        RebuildIndexes();
+
+    std::map<CScript, size_t>::iterator it = mapIndexByPayee.find(payee);
+    if (it == mapIndexByPayee.end())
+        return NULL;
+
+    CMasternode& mn = vMasternodes[it->second];
+    if (GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) != payee) {
+        // the entry was changed without MarkIndexesDirty()
+        RebuildIndexes();
+        return Find(payee);
     }
-    return NULL;
+    return &mn;
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
+    if (fIndexesDirty)
+        RebuildIndexes();
+
+    std::map<COutPoint, size_t>::iterator it = mapIndexByVin.find(vin.prevout);
+    if (it == mapIndexByVin.end())
+        return NULL;
+
+    CMasternode& mn = vMasternodes[it->second];
+    if (mn.vin.prevout != vin.prevout) {
+        RebuildIndexes();
+        return Find(vin);
     }
-    return NULL;
+    return &mn;
 }
 
 
@@ -465,11 +511,54 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
+    if (fIndexesDirty)
+        RebuildIndexes();
+
+    std::map<CPubKey, size_t>::iterator it = mapIndexByPubKey.find(pubKeyMasternode);
+    if (it == mapIndexByPubKey.end())
+        return NULL;
+
+    CMasternode& mn = vMasternodes[it->second];
+    if (mn.pubKeyMasternode != pubKeyMasternode) {
+        RebuildIndexes();
+        return Find(pubKeyMasternode);
     }
-    return NULL;
+    return &mn;
+}
+
+bool CMasternodeMan::GetMasternodeKey(const CTxIn& vin, CPubKey& pubKeyMasternode, int& protocolVersion)
+{
+    // the entry may move as soon as cs is released
+    LOCK(cs);
+
+    CMasternode* pmn = Find(vin);
+    if (pmn == NULL)
+        return false;
+
+    pubKeyMasternode = pmn->pubKeyMasternode;
+    protocolVersion = pmn->protocolVersion;
+    return true;
+}
+
+bool CMasternodeMan::HaveSeenMasternodeBroadcast(const uint256& hash)
+{
+    // the message handlers update the seen maps under cs_process_message, the rest under cs
+    TRY_LOCK(cs_process_message, lockMessage);
+    if (!lockMessage) return false;
+    TRY_LOCK(cs, lockMasternodes);
+    if (!lockMasternodes) return false;
+
+    return mapSeenMasternodeBroadcast.count(hash);
+}
+
+bool CMasternodeMan::HaveSeenMasternodePing(const uint256& hash)
+{
+    TRY_LOCK(cs_process_message, lockMessage);
+    if (!lockMessage) return false;
+    TRY_LOCK(cs, lockMasternodes);
+    if (!lockMasternodes) return false;
+
+    return mapSeenMasternodePing.count(hash);
 }
 
 //
@@ -592,9 +681,42 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
+const std::vector<pair<int64_t, size_t> >& CMasternodeMan::GetScores(int64_t nBlockHeight)
+{
+    // scores only depend on the block hash and the collateral, so the scores cached for this height
+    // are good for as long as it has the same block and the list does not change
+    uint256 hash = 0;
+    GetBlockHash(hash, nBlockHeight);
+
+    std::map<int64_t, pair<uint256, std::vector<pair<int64_t, size_t> > > >::iterator it = mapScoresByHeight.find(nBlockHeight);
+    if (it != mapScoresByHeight.end() && it->second.first == hash)
+        return it->second.second;
+
+    std::vector<pair<int64_t, size_t> > vecScores;
+    vecScores.reserve(vMasternodes.size());
+    for (size_t i = 0; i < vMasternodes.size(); i++) {
+        uint256 n = vMasternodes[i].CalculateScore(1, nBlockHeight);
+        int64_t n2 = n.GetCompact(false);
+
+        vecScores.push_back(make_pair(n2, i));
+    }
+
+    // highest score first, equal scores in list order
+    stable_sort(vecScores.begin(), vecScores.end(), CompareScoreIndex());
+
+    if (it == mapScoresByHeight.end() && mapScoresByHeight.size() >= MASTERNODE_SCORES_CACHE_SIZE)
+        mapScoresByHeight.erase(mapScoresByHeight.begin());
+
+    pair<uint256, std::vector<pair<int64_t, size_t> > >& scores = mapScoresByHeight[nBlockHeight];
+    scores.first = hash;
+    scores.second.swap(vecScores);
+    return scores.second;
+}
+
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
+
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
@@ -602,14 +724,16 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    bool fFilterAge = IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    int rank = 0;
+    BOOST_FOREACH (const PAIRTYPE(int64_t, size_t) & s, GetScores(nBlockHeight)) {
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
         }
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+        if (fFilterAge) {
             nMasternode_Age = GetAdjustedTime() - mn.sigTime;
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
@@ -620,18 +744,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -641,36 +756,35 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
+    LOCK(cs);
+
     std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
     //make sure we know about this block
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    // enabled masternodes by score, followed by the ones that are not enabled
+    std::vector<size_t> vecDisabled;
+    int rank = 0;
+    BOOST_FOREACH (const PAIRTYPE(int64_t, size_t) & s, GetScores(nBlockHeight)) {
+        CMasternode& mn = vMasternodes[s.second];
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
 
         if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(make_pair(9999, mn));
+            vecDisabled.push_back(s.second);
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn));
+        rank++;
+        vecMasternodeRanks.push_back(make_pair(rank, mn));
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode) & s, vecMasternodeScores) {
+    BOOST_FOREACH (size_t i, vecDisabled) {
         rank++;
-        vecMasternodeRanks.push_back(make_pair(rank, s.second));
+        vecMasternodeRanks.push_back(make_pair(rank, vMasternodes[i]));
     }
 
     return vecMasternodeRanks;
@@ -678,29 +792,20 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    int rank = 0;
+    BOOST_FOREACH (const PAIRTYPE(int64_t, size_t) & s, GetScores(nBlockHeight)) {
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return &mn;
         }
     }
 
@@ -943,6 +1048,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     LogPrint("masternode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
                     if (pmn->protocolVersion < GETHEADERS_VERSION) {
                         pmn->pubKeyMasternode = pubkey2;
+                        MarkIndexesDirty();
                         pmn->sigTime = sigTime;
                         pmn->sig = vchSig;
                         pmn->protocolVersion = protocolVersion;
@@ -1010,14 +1116,19 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             uint256 hashBlock = 0;
             CTransaction tx2;
             GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 25000 WGR tx -> 1 confirmation
-                CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-                if (pConfIndex->GetBlockTime() > sigTime) {
-                    LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
-                        sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
-                    return;
+            {
+                TRY_LOCK(cs_main, lockMain);
+                if (!lockMain) return;
+
+                BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+                if (mi != mapBlockIndex.end() && (*mi).second) {
+                    CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 25000 WGR tx -> 1 confirmation
+                    CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+                    if (pConfIndex->GetBlockTime() > sigTime) {
+                        LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
+                            sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
+                        return;
+                    }
                 }
             }
 
@@ -1141,6 +1252,8 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            fIndexesDirty = true;
+            mapScoresByHeight.clear();
             break;
         }
         ++it;
@@ -17,6 +17,7 @@
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODE_SCORES_CACHE_SIZE 20
 
 using namespace std;
 
@@ -67,6 +68,22 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // positions in vMasternodes by collateral outpoint, payee script and masternode pubkey (the first entry
+    // with that key), so Find() does not scan the whole list. Rebuilt when entries are removed or change keys
+    std::map<COutPoint, size_t> mapIndexByVin;
+    std::map<CScript, size_t> mapIndexByPayee;
+    std::map<CPubKey, size_t> mapIndexByPubKey;
+    bool fIndexesDirty;
+
+    void AddToIndexes(size_t nIndex);
+    void RebuildIndexes();
+
+    // masternode scores for recently ranked block heights, best first, as (score, position in vMasternodes),
+    // with the hash of the block they were calculated for. Cleared whenever masternodes are added or removed
+    std::map<int64_t, pair<uint256, std::vector<pair<int64_t, size_t> > > > mapScoresByHeight;
+
+    const std::vector<pair<int64_t, size_t> >& GetScores(int64_t nBlockHeight);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -90,6 +107,11 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+
+        if (ser_action.ForRead()) {
+            fIndexesDirty = true;
+            mapScoresByHeight.clear();
+        }
     }
 
     CMasternodeMan();
@@ -121,6 +143,13 @@ public:
     CMasternode* Find(const CTxIn& vin);
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
+    /// Copy the key and protocol version of an entry, for threads that must not hold on to the entry itself
+    bool GetMasternodeKey(const CTxIn& vin, CPubKey& pubKeyMasternode, int& protocolVersion);
+
+    /// Whether a broadcast or ping was seen already; false while another thread is updating the maps
+    bool HaveSeenMasternodeBroadcast(const uint256& hash);
+    bool HaveSeenMasternodePing(const uint256& hash);
+
     /// Find an entry in the masternode list that is next to be paid
     CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
@@ -156,6 +185,9 @@ public:
 
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
+
+    /// Rebuild the lookup indexes before the next Find(), after an entry's keys were changed in place
+    void MarkIndexesDirty();
 };
 
 #endif
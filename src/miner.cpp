@@ -94,6 +94,140 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
 }
 
+//! Whether a mempool transaction may go into a block at nHeight at all
+static bool IsBlockCandidate(const CTransaction& tx, int nHeight)
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+        return false;
+    if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+        return false;
+    return true;
+}
+
+//! A transaction has more in-mempool ancestors than any of them, so this puts parents first
+class CompareTxMemPoolEntryByAncestorCount
+{
+public:
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+    {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    }
+};
+
+/**
+ * The block being filled from the mempool with its running size, sigop and fee totals.
+ * Transactions are checked against the view and added one at a time, parents first.
+ */
+class CBlockAssembler
+{
+public:
+    CBlockTemplate* pblocktemplate;
+    CCoinsViewCache& view;
+    int nHeight;
+    unsigned int nBlockMaxSize;
+    bool fPrintPriority;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    int nBlockSigOps;
+    CAmount nFees;
+    set<uint256> setInBlock;
+    vector<CBigNum> vBlockSerials;
+
+    CBlockAssembler(CBlockTemplate* pblocktemplateIn, CCoinsViewCache& viewIn, int nHeightIn, unsigned int nBlockMaxSizeIn) : pblocktemplate(pblocktemplateIn), view(viewIn), nHeight(nHeightIn), nBlockMaxSize(nBlockMaxSizeIn), fPrintPriority(false), nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nFees(0) {}
+
+    bool AddTx(const CTransaction& tx, double dPriority, const CFeeRate& feeRate);
+};
+
+bool CBlockAssembler::AddTx(const CTransaction& tx, double dPriority, const CFeeRate& feeRate)
+{
+    // Size limits
+    unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    if (nBlockSize + nTxSize >= nBlockMaxSize)
+        return false;
+
+    // Legacy limits on sigOps:
+    unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+    unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+    if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+        return false;
+
+    if (!view.HaveInputs(tx))
+        return false;
+
+    //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+    if (!tx.IsZerocoinSpend()) {
+        for (const CTxIn& txin : tx.vin) {
+            if (mapInvalidOutPoints.count(txin.prevout)) {
+                LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+                return false;
+            }
+        }
+    }
+
+    // double check that there are no double spent zWgr spends in this block or tx
+    vector<CBigNum> vTxSerials;
+    if (tx.IsZerocoinSpend()) {
+        int nHeightTx = 0;
+        if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+            return false;
+
+        bool fDoubleSerial = false;
+        for (const CTxIn txIn : tx.vin) {
+            if (txIn.scriptSig.IsZerocoinSpend()) {
+                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+                if (!spend.HasValidSerial(Params().Zerocoin_Params()))
+                    fDoubleSerial = true;
+                if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
+                    fDoubleSerial = true;
+                if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber()))
+                    fDoubleSerial = true;
+                if (fDoubleSerial)
+                    break;
+                vTxSerials.emplace_back(spend.getCoinSerialNumber());
+            }
+        }
+        //This zWgr serial has already been included in the block, do not add this tx.
+        if (fDoubleSerial)
+            return false;
+    }
+
+    CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+    nTxSigOps += GetP2SHSigOpCount(tx, view);
+    if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+        return false;
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    CValidationState state;
+    if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        return false;
+
+    CTxUndo txundo;
+    UpdateCoins(tx, state, view, txundo, nHeight);
+
+    // Added
+    pblocktemplate->block.vtx.push_back(tx);
+    pblocktemplate->vTxFees.push_back(nTxFees);
+    pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+    nBlockSize += nTxSize;
+    ++nBlockTx;
+    nBlockSigOps += nTxSigOps;
+    nFees += nTxFees;
+    setInBlock.insert(tx.GetHash());
+
+    for (const CBigNum bnSerial : vTxSerials)
+        vBlockSerials.emplace_back(bnSerial);
+
+    if (fPrintPriority) {
+        LogPrintf("priority %.1f fee %s txid %s\n",
+            dPriority, feeRate.ToString(), tx.GetHash().ToString());
+    }
+    return true;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
 {
     CReserveKey reservekey(pwallet);
@@ -179,219 +313,142 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-            if(GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()){
-                continue;
-            }
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                //zerocoinspend has special vin
-                if (tx.IsZerocoinSpend()) {
-                    nTotalIn = tx.GetZerocoinSpent();
-                    break;
-                }
+        CBlockAssembler assembler(pblocktemplate.get(), view, nHeight, nBlockMaxSize);
+        assembler.fPrintPriority = GetBoolArg("-printpriority", false);
+
+        // Fill the first nBlockPrioritySize bytes by priority. Priority grows with the chain, so this
+        // order is made per block; a transaction waits for its in-mempool parents to be added first.
+        if (nBlockPrioritySize > 0) {
+            list<COrphan> vOrphan; // list memory doesn't move
+            map<uint256, vector<COrphan*> > mapDependers;
+
+            // This vector will be sorted into a priority queue:
+            vector<TxPriority> vecPriority;
+            vecPriority.reserve(mempool.mapTx.size());
+            for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
+                 mi != mempool.mapTx.end(); ++mi) {
+                const CTransaction& tx = mi->second.GetTx();
+                if (!IsBlockCandidate(tx, nHeight))
+                    continue;
 
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
+                double dPriority = mi->second.GetPriority(nHeight);
+                CAmount nFeeDelta = 0; // already in the modified fee
+                mempool.ApplyDeltas(mi->first, dPriority, nFeeDelta);
+                CFeeRate feeRate(mi->second.GetModifiedFee(), mi->second.GetTxSize());
 
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
+                const set<uint256>& setParents = mempool.GetMemPoolParents(mi->first);
+                if (setParents.empty()) {
+                    vecPriority.push_back(TxPriority(dPriority, feeRate, &tx));
                     continue;
                 }
 
-                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-                if (mapInvalidOutPoints.count(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    fMissingInputs = true;
-                    break;
-                }
-
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
+                // Has to wait for dependencies
+                vOrphan.push_back(COrphan(&tx));
+                COrphan* porphan = &vOrphan.back();
+                porphan->setDependsOn = setParents;
                 porphan->dPriority = dPriority;
                 porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        vector<CBigNum> vBlockSerials;
-        vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
+                BOOST_FOREACH (const uint256& hashParent, setParents)
+                    mapDependers[hashParent].push_back(porphan);
+            }
 
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
+            TxPriorityCompare comparer(false);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.IsZerocoinSpend() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
+            while (!vecPriority.empty()) {
+                // Take highest priority transaction off the priority queue:
+                double dPriority = vecPriority.front().get<0>();
+                CFeeRate feeRate = vecPriority.front().get<1>();
+                const CTransaction& tx = *(vecPriority.front().get<2>());
 
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
 
-            if (!view.HaveInputs(tx))
-                continue;
+                // The rest goes by fee once past the priority size or we run out of high-priority
+                // transactions:
+                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                if ((assembler.nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))
+                    break;
 
-            // double check that there are no double spent zWgr spends in this block or tx
-            if (tx.IsZerocoinSpend()) {
-                int nHeightTx = 0;
-                if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+                if (!assembler.AddTx(tx, dPriority, feeRate))
                     continue;
 
-                bool fDoubleSerial = false;
-                for (const CTxIn txIn : tx.vin) {
-                    if (txIn.scriptSig.IsZerocoinSpend()) {
-                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-                        if (!spend.HasValidSerial(Params().Zerocoin_Params()))
-                            fDoubleSerial = true;
-                        if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (count(vTxSerials.begin(), vTxSerials.end(), spend.getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (fDoubleSerial)
-                            break;
-                        vTxSerials.emplace_back(spend.getCoinSerialNumber());
+                // Add transactions that depend on this one to the priority queue
+                const uint256& hash = tx.GetHash();
+                if (mapDependers.count(hash)) {
+                    BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
+                        if (!porphan->setDependsOn.empty()) {
+                            porphan->setDependsOn.erase(hash);
+                            if (porphan->setDependsOn.empty()) {
+                                vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
+                                std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                            }
+                        }
                     }
                 }
-                //This zWgr serial has already been included in the block, do not add this tx.
-                if (fDoubleSerial)
-                    continue;
             }
+        }
 
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+        // Then walk the mempool's ancestor score index, adding each transaction together with its
+        // ancestors that are not in the block yet. Scores are not recounted for what is already in.
+        set<uint256> setFailed;
+        for (CTxMemPool::ancestor_score_set::const_iterator it = mempool.setAncestorScore.begin();
+             it != mempool.setAncestorScore.end(); ++it) {
+            const CTxMemPoolEntry& entry = **it;
+            const uint256& hash = entry.GetTx().GetHash();
+            if (assembler.setInBlock.count(hash) || setFailed.count(hash))
                 continue;
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+            set<uint256> setAncestors;
+            mempool.CalculateMemPoolAncestors(hash, setAncestors);
+            vector<const CTxMemPoolEntry*> vPackage;
+            bool fFailedAncestor = false;
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (assembler.setInBlock.count(hashAncestor))
+                    continue;
+                if (setFailed.count(hashAncestor)) {
+                    fFailedAncestor = true;
+                    break;
+                }
+                vPackage.push_back(&mempool.mapTx[hashAncestor]);
+            }
+            if (fFailedAncestor) {
+                setFailed.insert(hash);
                 continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
             }
+            vPackage.push_back(&entry);
+            std::sort(vPackage.begin(), vPackage.end(), CompareTxMemPoolEntryByAncestorCount());
+
+            uint64_t nPackageSize = 0;
+            CAmount nPackageFees = 0;
+            bool fFeeExempt = false;
+            BOOST_FOREACH (const CTxMemPoolEntry* pentry, vPackage) {
+                nPackageSize += pentry->GetTxSize();
+                nPackageFees += pentry->GetModifiedFee();
+                double dPriorityDelta = 0;
+                CAmount nFeeDelta = 0;
+                mempool.ApplyDeltas(pentry->GetTx().GetHash(), dPriorityDelta, nFeeDelta);
+                if (pentry->GetTx().IsZerocoinSpend() || dPriorityDelta > 0 || nFeeDelta > 0)
+                    fFeeExempt = true;
+            }
+            if (assembler.nBlockSize + nPackageSize >= nBlockMaxSize)
+                continue;
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
+            // Skip free transactions if we're past the minimum block size:
+            if (!fFeeExempt && (CFeeRate(nPackageFees, nPackageSize) < ::minRelayTxFee) && (assembler.nBlockSize + nPackageSize >= nBlockMinSize))
+                continue;
+
+            BOOST_FOREACH (const CTxMemPoolEntry* pentry, vPackage) {
+                const CTransaction& tx = pentry->GetTx();
+                if (!IsBlockCandidate(tx, nHeight) ||
+                    !assembler.AddTx(tx, pentry->GetPriority(nHeight), CFeeRate(pentry->GetModifiedFee(), pentry->GetTxSize()))) {
+                    setFailed.insert(tx.GetHash());
+                    setFailed.insert(hash);
+                    break;
                 }
             }
         }
+        nFees = assembler.nFees;
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -403,9 +460,9 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             }
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u\n", nBlockSize);
+        nLastBlockTx = assembler.nBlockTx;
+        nLastBlockSize = assembler.nBlockSize;
+        LogPrintf("CreateNewBlock(): total size %u\n", assembler.nBlockSize);
 
         // Compute final coinbase transaction.
         pblock->vtx[0].vin[0].scriptSig = CScript() << nHeight << OP_0;
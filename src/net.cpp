@@ -28,6 +28,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -85,6 +89,8 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = 125;
+SocketEventsMode nSocketEventsMode = SOCKETEVENTS_SELECT;
+int nMessageHandlerWorkers = 0;
 bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
@@ -386,6 +392,86 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+bool SetSocketEventsMode(const std::string& strMode)
+{
+    if (strMode == "select") {
+        nSocketEventsMode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll") {
+        nSocketEventsMode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return "select, epoll";
+#else
+    return "select";
+#endif
+}
+
+// select() cannot wait on descriptors at or above FD_SETSIZE, epoll can
+static bool IsSocketEventsCapable(SOCKET hSocket)
+{
+    return nSocketEventsMode != SOCKETEVENTS_SELECT || IsSelectableSocket(hSocket);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+// Listening sockets are registered level-triggered with a NULL pointer, peer
+// sockets edge-triggered with their CNode. A registration has to be removed
+// before the socket is closed: a copy of the descriptor inherited by a child
+// process would otherwise keep it, and the CNode pointer, in the epoll set.
+static int hEpollFd = -1;
+
+static void EpollControl(int nOp, SOCKET hSocket, uint32_t nEvents, void* ptr)
+{
+    struct epoll_event event;
+    event.events = nEvents;
+    event.data.ptr = ptr;
+    if (epoll_ctl(hEpollFd, nOp, hSocket, &event) == SOCKET_ERROR)
+        LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+}
+#endif
+
+static void SocketEventsAdd(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollFd != -1 && pnode->hSocket != INVALID_SOCKET)
+        EpollControl(EPOLL_CTL_ADD, pnode->hSocket, EPOLLIN | EPOLLET, pnode);
+#endif
+}
+
+static void SocketEventsRemove(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollFd != -1 && pnode->hSocket != INVALID_SOCKET)
+        EpollControl(EPOLL_CTL_DEL, pnode->hSocket, 0, NULL);
+#endif
+}
+
+// requires LOCK(cs_vSend)
+static void SocketEventsWantSend(CNode* pnode, bool fWantSend)
+{
+    if (pnode->fWantSendEvents == fWantSend)
+        return;
+#ifdef HAVE_SYS_EPOLL_H
+    // re-arming the registration reports the socket right away if it is already writable
+    if (hEpollFd != -1 && pnode->hSocket != INVALID_SOCKET) {
+        uint32_t nEvents = EPOLLIN | EPOLLET;
+        if (fWantSend)
+            nEvents |= EPOLLOUT;
+        EpollControl(EPOLL_CTL_MOD, pnode->hSocket, nEvents, pnode);
+    }
+#endif
+    pnode->fWantSendEvents = fWantSend;
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMaster)
 {
     if (pszDest == NULL) {
@@ -414,7 +500,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsSocketEventsCapable(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -447,9 +533,16 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest, bool obfuScationMa
 void CNode::CloseSocketDisconnect()
 {
     fDisconnect = true;
-    if (hSocket != INVALID_SOCKET) {
-        LogPrint("net", "disconnecting peer=%d\n", id);
-        CloseSocket(hSocket);
+    {
+        // SocketSendData runs under cs_vSend, so it never sends to or
+        // re-registers a descriptor that was closed and handed out again.
+        // If the lock is busy the socket is closed when the CNode is deleted.
+        TRY_LOCK(cs_vSend, lockSend);
+        if (lockSend && hSocket != INVALID_SOCKET) {
+            LogPrint("net", "disconnecting peer=%d\n", id);
+            SocketEventsRemove(this);
+            CloseSocket(hSocket);
+        }
     }
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
@@ -736,7 +829,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -831,10 +924,341 @@ void SocketSendData(CNode* pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    // only ask to be told about writability while there is something to send
+    SocketEventsWantSend(pnode, !pnode->vSendMsg.empty());
 }
 
 static list<CNode*> vNodesDisconnected;
 
+static void AcceptConnection(const ListenSocket& hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket != INVALID_SOCKET)
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            LogPrintf("Warning: Unknown socket family\n");
+
+    bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (hSocket == INVALID_SOCKET) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+    } else if (!IsSocketEventsCapable(hSocket)) {
+        LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
+        LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (CNode::IsBanned(addr) && !whitelisted) {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else {
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        pnode->fWhitelisted = whitelisted;
+
+        {
+            LOCK(cs_vNodes);
+            vNodes.push_back(pnode);
+        }
+    }
+}
+
+// requires LOCK(cs_vRecvMsg)
+// returns false once nothing more can be read from the socket for now
+static bool SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0) {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        return true;
+    } else if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0) {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60) {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+static void SocketEventsSelect()
+{
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                    continue;
+                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec / 1000);
+    }
+
+    //
+    // Accept new connections
+    //
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            AcceptConnection(hListenSocket);
+    }
+
+    //
+    // Service each socket
+    //
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
+    BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+        boost::this_thread::interruption_point();
+
+        //
+        // Receive
+        //
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv)
+                SocketRecvData(pnode);
+        }
+
+        //
+        // Send
+        //
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend)
+                SocketSendData(pnode);
+        }
+
+        //
+        // Inactivity checking
+        //
+        InactivityCheck(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+// Nodes with readiness reported by epoll that has not been fully acted upon.
+// Edge-triggered epoll only reports a socket again after it has been drained,
+// so a node whose lock was busy or whose receive buffer was full is kept here
+// and retried. Only used by the socket handler thread.
+static set<CNode*> setNodesPendingEvents;
+
+static void SocketEventsEpoll()
+{
+    static const int MAX_EPOLL_EVENTS = 256;
+    static bool fMoreWork = false;
+    static int64_t nLastInactivityCheck = 0;
+
+    // there is no vSend to poll, writability is reported for nodes with queued data
+    struct epoll_event vEvents[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(hEpollFd, vEvents, MAX_EPOLL_EVENTS, fMoreWork ? 0 : 50);
+    boost::this_thread::interruption_point();
+
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        nEvents = 0;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        CNode* pnode = (CNode*)vEvents[i].data.ptr;
+        if (pnode == NULL) {
+            //
+            // Accept new connections
+            //
+            BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+                if (hListenSocket.socket != INVALID_SOCKET)
+                    AcceptConnection(hListenSocket);
+            continue;
+        }
+        // a disconnected node may still be registered until it is deleted
+        if (pnode->fDisconnect)
+            continue;
+        if (vEvents[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            pnode->fHasRecvData = true;
+        if (vEvents[i].events & EPOLLOUT)
+            pnode->fCanSendData = true;
+        setNodesPendingEvents.insert(pnode);
+    }
+
+    //
+    // Service the sockets that are ready
+    //
+    fMoreWork = false;
+    set<CNode*>::iterator it = setNodesPendingEvents.begin();
+    while (it != setNodesPendingEvents.end()) {
+        CNode* pnode = *it;
+        boost::this_thread::interruption_point();
+
+        if (pnode->hSocket != INVALID_SOCKET && pnode->fCanSendData) {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend) {
+                // a partial send leaves the socket unwritable, and the next
+                // edge arrives once it drains
+                SocketSendData(pnode);
+                pnode->fCanSendData = false;
+            }
+        }
+
+        // drain the write buffer before receiving more, as with select()
+        if (pnode->hSocket != INVALID_SOCKET && pnode->fHasRecvData && pnode->nSendSize == 0) {
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                pnode->GetTotalRecvSize() <= ReceiveFloodSize())) {
+                if (SocketRecvData(pnode))
+                    fMoreWork = true;
+                else
+                    pnode->fHasRecvData = false;
+            }
+        }
+
+        if (pnode->hSocket == INVALID_SOCKET || pnode->fDisconnect || (!pnode->fHasRecvData && !pnode->fCanSendData))
+            setNodesPendingEvents.erase(it++);
+        else
+            it++;
+    }
+
+    //
+    // Inactivity checking, which needs no socket events, once a second
+    //
+    int64_t nTime = GetTime();
+    if (nTime != nLastInactivityCheck) {
+        nLastInactivityCheck = nTime;
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes)
+            if (pnode->hSocket != INVALID_SOCKET)
+                InactivityCheck(pnode);
+    }
+}
+#endif
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -857,6 +1281,9 @@ void ThreadSocketHandler()
 
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
+#ifdef HAVE_SYS_EPOLL_H
+                    setNodesPendingEvents.erase(pnode);
+#endif
 
                     // hold in disconnected pool until all refs are released
                     if (pnode->fNetworkNode || pnode->fInbound)
@@ -900,218 +1327,12 @@ void ThreadSocketHandler()
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
-
-        //
-        // Accept new connections
-        //
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                struct sockaddr_storage sockaddr;
-                socklen_t len = sizeof(sockaddr);
-                SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
-                CAddress addr;
-                int nInbound = 0;
-
-                if (hSocket != INVALID_SOCKET)
-                    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                        LogPrintf("Warning: Unknown socket family\n");
-
-                bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
-                {
-                    LOCK(cs_vNodes);
-                    BOOST_FOREACH (CNode* pnode, vNodes)
-                        if (pnode->fInbound)
-                            nInbound++;
-                }
-
-                if (hSocket == INVALID_SOCKET) {
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
-                        LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
-                    LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
-                    LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (CNode::IsBanned(addr) && !whitelisted) {
-                    LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else {
-                    CNode* pnode = new CNode(hSocket, addr, "", true);
-                    pnode->AddRef();
-                    pnode->fWhitelisted = whitelisted;
-
-                    {
-                        LOCK(cs_vNodes);
-                        vNodes.push_back(pnode);
-                    }
-                }
-            }
-        }
-
-        //
-        // Service each socket
-        //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->AddRef();
-        }
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            boost::this_thread::interruption_point();
-
-            //
-            // Receive
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
-            }
-
-            //
-            // Send
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    SocketSendData(pnode);
-            }
-
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
-        }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->Release();
-        }
+#ifdef HAVE_SYS_EPOLL_H
+        if (nSocketEventsMode == SOCKETEVENTS_EPOLL)
+            SocketEventsEpoll();
+        else
+#endif
+            SocketEventsSelect();
     }
 }
 
@@ -1492,7 +1713,16 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+void WakeMessageHandlers()
+{
+    messageHandlerCondition.notify_all();
+}
+
+/**
+ * Process received messages. The main handler thread also answers getdata requests and sends
+ * messages; workers only process the classes of messages main.cpp leaves to them.
+ */
+static void MessageHandlerLoop(bool fWorker)
 {
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
@@ -1523,18 +1753,19 @@ void ThreadMessageHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
-                    if (!g_signals.ProcessMessages(pnode))
+                    bool fMoreWork = false;
+                    if (!g_signals.ProcessMessages(pnode, fWorker, fMoreWork))
                         pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
-                        }
-                    }
+                    if (fMoreWork)
+                        fSleep = false;
                 }
             }
             boost::this_thread::interruption_point();
 
+            if (fWorker)
+                continue;
+
             // Send messages
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
@@ -1556,6 +1787,16 @@ void ThreadMessageHandler()
     }
 }
 
+void ThreadMessageHandler()
+{
+    MessageHandlerLoop(false);
+}
+
+void ThreadMessageHandlerWorker()
+{
+    MessageHandlerLoop(true);
+}
+
 // ppcoin: stake minter thread
 void static ThreadStakeMinter()
 {
@@ -1735,6 +1976,19 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
         semOutbound = new CSemaphore(nMaxOutbound);
     }
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (nSocketEventsMode == SOCKETEVENTS_EPOLL && hEpollFd == -1) {
+        hEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpollFd == -1) {
+            LogPrintf("epoll_create1 failed with error %s, using select() instead\n", NetworkErrorString(WSAGetLastError()));
+            nSocketEventsMode = SOCKETEVENTS_SELECT;
+        } else {
+            BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+                EpollControl(EPOLL_CTL_ADD, hListenSocket.socket, EPOLLIN, NULL);
+        }
+    }
+#endif
+
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
@@ -1763,6 +2017,8 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // Process messages
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    for (int i = 0; i < nMessageHandlerWorkers; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgworker", &ThreadMessageHandlerWorker));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -1804,6 +2060,13 @@ public:
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
 
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpollFd != -1) {
+            close(hEpollFd);
+            hEpollFd = -1;
+        }
+#endif
+
         // clean up some globals (to help leak detection)
         BOOST_FOREACH (CNode* pnode, vNodes)
             delete pnode;
@@ -2072,6 +2335,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fWantSendEvents = false;
+    fHasRecvData = false;
+    fCanSendData = false;
     hashContinue = 0;
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2094,6 +2360,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     else
         LogPrint("net", "Added connection peer=%d\n", id);
 
+    // Registered before anything is sent, SocketSendData may ask for writability
+    SocketEventsAdd(this);
+
     // Be shy and don't send version until we hear
     if (hSocket != INVALID_SOCKET && !fInbound)
         PushVersion();
@@ -2103,6 +2372,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 
 CNode::~CNode()
 {
+    SocketEventsRemove(this);
     CloseSocket(hSocket);
 
     if (pfilter)
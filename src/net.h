@@ -63,6 +63,17 @@ static const bool DEFAULT_UPNP = false;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 
+/** How ThreadSocketHandler waits for sockets to become ready */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT, // select() over every socket, limited to FD_SETSIZE descriptors
+    SOCKETEVENTS_EPOLL,  // edge-triggered epoll (Linux only)
+};
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+/** -msghandlerthreads default: masternode, budget and SwiftX messages are processed on the main message handler */
+static const int DEFAULT_MESSAGE_HANDLER_WORKERS = 0;
+/** Messages of one class are processed one at a time, so more workers than classes would sit idle */
+static const int MAX_MESSAGE_HANDLER_WORKERS = 2;
+
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
 
@@ -81,13 +92,19 @@ bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
+/** Wake the message handler threads, for a message left to another one of them */
+void WakeMessageHandlers();
+/** Select the socket events backend by name, false if it is unknown or not available on this system */
+bool SetSocketEventsMode(const std::string& strMode);
+/** The socket events backends this build supports, for the help message */
+std::string GetSupportedSocketEventsModes();
 
 typedef int NodeId;
 
 // Signals for message handling
 struct CNodeSignals {
     boost::signals2::signal<int()> GetHeight;
-    boost::signals2::signal<bool(CNode*)> ProcessMessages;
+    boost::signals2::signal<bool(CNode*, bool, bool&)> ProcessMessages;
     boost::signals2::signal<bool(CNode*, bool)> SendMessages;
     boost::signals2::signal<void(NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void(NodeId)> FinalizeNode;
@@ -129,6 +146,8 @@ extern uint64_t nLocalServices;
 extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
+extern SocketEventsMode nSocketEventsMode;
+extern int nMessageHandlerWorkers;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -188,6 +207,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fSigCheckQueued; // signature check queued ahead of processing
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -195,6 +216,7 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fSigCheckQueued = false;
     }
 
     bool complete() const
@@ -290,6 +312,11 @@ public:
     uint64_t nSendBytes;
     std::deque<CSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
+    bool fWantSendEvents; // socket registered for writability, guarded by cs_vSend
+
+    // Edge-triggered readiness not yet acted upon, only used by the socket thread
+    bool fHasRecvData;
+    bool fCanSendData;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -17,6 +17,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
 #include <algorithm>
 #include <boost/assign/list_of.hpp>
@@ -38,6 +39,50 @@ map<uint256, CObfuscationBroadcastTx> mapObfuscationBroadcastTxes;
 // Keep track of the active Masternode
 CActiveMasternode activeMasternode;
 
+namespace
+{
+/**
+ * Valid message signature cache, so a signature checked ahead of time by the
+ * masternode signature check threads is not recovered again when the message
+ * is processed
+ */
+class CMessageSignatureCache
+{
+private:
+    //! entries are the hash of (message hash, signature, key id)
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_msgsigcache;
+
+public:
+    bool Get(const uint256& hash)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        return setValid.count(hash) > 0;
+    }
+
+    void Set(const uint256& hash)
+    {
+        // about 32 bytes per entry, enough for the pings and votes of a few
+        // thousand masternodes
+        const size_t nMaxCacheSize = 50000;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+
+        while (setValid.size() >= nMaxCacheSize) {
+            // Evict a random entry, as the transaction signature cache does
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(hash);
+    }
+};
+
+CMessageSignatureCache messageSignatureCache;
+}
+
 /* *** BEGIN OBFUSCATION MAGIC - WGR **********
     Copyright (c) 2014-2015, Dash Developers
         eduffield - evan@dashpay.io
@@ -2168,9 +2213,16 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    uint256 hashMessage = ss.GetHash();
+
+    CHashWriter ssCache(SER_GETHASH, 0);
+    ssCache << hashMessage << vchSig << pubkey.GetID();
+    uint256 hashCache = ssCache.GetHash();
+    if (messageSignatureCache.Get(hashCache))
+        return true;
 
     CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (!pubkey2.RecoverCompact(hashMessage, vchSig)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
@@ -2178,7 +2230,11 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     if (fDebug && pubkey2.GetID() != pubkey.GetID())
         LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    if (pubkey2.GetID() != pubkey.GetID())
+        return false;
+
+    messageSignatureCache.Set(hashCache);
+    return true;
 }
 
 bool CObfuscationQueue::Sign()
@@ -173,6 +173,56 @@ public:
     };
 };
 
+/** Accumulator witness of one of the wallet's mints, as of the last block whose
+ * mints were added to it. Lets a spend resume from here instead of adding every
+ * mint published since the coin was minted.
+ */
+class CZerocoinWitness
+{
+public:
+    CBigNum bnPubcoin;     //! the pubcoin this witness is for
+    int nHeightMintAdded;
+    int nAccStartHeight;   //! first block whose mints were added
+    int nHeight;           //! last block whose mints were added
+    uint256 hashBlock;     //! hash of that block, so a reorg invalidates the witness
+    CBigNum bnWitness;
+    int nMintsAdded;
+    int nCheckpointsAdded;
+
+    CZerocoinWitness()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        bnPubcoin = 0;
+        nHeightMintAdded = 0;
+        nAccStartHeight = 0;
+        nHeight = -1;
+        hashBlock = 0;
+        bnWitness = 0;
+        nMintsAdded = 0;
+        nCheckpointsAdded = 0;
+    }
+
+    bool IsNull() const { return nHeight == -1; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(bnPubcoin);
+        READWRITE(nHeightMintAdded);
+        READWRITE(nAccStartHeight);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(bnWitness);
+        READWRITE(nMintsAdded);
+        READWRITE(nCheckpointsAdded);
+    };
+};
+
 class CZerocoinSpendReceipt
 {
 private:
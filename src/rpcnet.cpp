@@ -350,6 +350,57 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+static std::string GetMessageClassName(MessageClass messageClass)
+{
+    switch (messageClass) {
+    case MSG_CLASS_MASTERNODE:
+        return "masternode";
+    case MSG_CLASS_SWIFTTX:
+        return "swifttx";
+    default:
+        return "chain";
+    }
+}
+
+UniValue getmessagestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagestats\n"
+            "\nReturns how long the network messages processed so far took, per command.\n"
+            "Commands this node does not know are counted under \"other\".\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {           (json object) The statistics of one message command\n"
+            "    \"class\": \"xxxx\",     (string) The thread class: chain (main message handler), masternode or swifttx\n"
+            "    \"count\": n,          (numeric) The number of messages processed\n"
+            "    \"totaltime\": n,      (numeric) The total processing time in microseconds\n"
+            "    \"avgtime\": n,        (numeric) The average processing time in microseconds\n"
+            "    \"maxtime\": n,        (numeric) The longest processing time in microseconds\n"
+            "    \"avgwait\": n         (numeric) The average time in microseconds from receipt until processing started\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") + HelpExampleRpc("getmessagestats", ""));
+
+    std::map<std::string, CMessageStats> mapStats;
+    GetMessageStats(mapStats);
+
+    UniValue ret(UniValue::VOBJ);
+    for (std::map<std::string, CMessageStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CMessageStats& stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("class", GetMessageClassName(GetMessageClass(it->first))));
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("totaltime", stats.nTotalTime));
+        obj.push_back(Pair("avgtime", stats.nTotalTime / (int64_t)stats.nCount));
+        obj.push_back(Pair("maxtime", stats.nMaxTime));
+        obj.push_back(Pair("avgwait", stats.nTotalWaitTime / (int64_t)stats.nCount));
+        ret.push_back(Pair(it->first, obj));
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
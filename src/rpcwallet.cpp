@@ -2338,8 +2338,7 @@ UniValue listmintedzerocoins(const UniValue& params, bool fHelp)
     if (pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listPubCoin = walletdb.ListMintedCoins(true, false, true);
+    list<CZerocoinMint> listPubCoin = pwalletMain->ListMintedCoins(true, false, true);
 
     UniValue jsonList(UniValue::VARR);
     for (const CZerocoinMint& pubCoinItem : listPubCoin) {
@@ -2360,8 +2359,7 @@ UniValue listzerocoinamounts(const UniValue& params, bool fHelp)
     if (pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listPubCoin = walletdb.ListMintedCoins(true, true, true);
+    list<CZerocoinMint> listPubCoin = pwalletMain->ListMintedCoins(true, true, true);
 
     std::map<libzerocoin::CoinDenomination, CAmount> spread;
     for (const auto& denom : libzerocoin::zerocoinDenomList)
@@ -2606,8 +2604,7 @@ UniValue resetmintzerocoin(const UniValue& params, bool fHelp)
     if (params.size() == 1)
         fExtendedSearch = params[0].get_bool();
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, true);
+    list<CZerocoinMint> listMints = pwalletMain->ListMintedCoins(false, false, true);
     vector<CZerocoinMint> vMintsToFind{ std::make_move_iterator(std::begin(listMints)), std::make_move_iterator(std::end(listMints)) };
     vector<CZerocoinMint> vMintsMissing;
     vector<CZerocoinMint> vMintsToUpdate;
@@ -2618,7 +2615,7 @@ UniValue resetmintzerocoin(const UniValue& params, bool fHelp)
     // update the meta data of mints that were marked for updating
     UniValue arrUpdated(UniValue::VARR);
     for (CZerocoinMint mint : vMintsToUpdate) {
-        walletdb.WriteZerocoinMint(mint);
+        pwalletMain->WriteZerocoinMint(mint);
         arrUpdated.push_back(mint.GetValue().GetHex());
     }
 
@@ -2626,7 +2623,7 @@ UniValue resetmintzerocoin(const UniValue& params, bool fHelp)
     UniValue arrDeleted(UniValue::VARR);
     for (CZerocoinMint mint : vMintsMissing) {
         arrDeleted.push_back(mint.GetValue().GetHex());
-        walletdb.ArchiveMintOrphan(mint);
+        pwalletMain->ArchiveMintOrphan(mint);
     }
 
     UniValue obj(UniValue::VOBJ);
@@ -2644,7 +2641,7 @@ UniValue resetspentzerocoin(const UniValue& params, bool fHelp)
             + HelpRequiringPassphrase());
 
     CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, false);
+    list<CZerocoinMint> listMints = pwalletMain->ListMintedCoins(false, false, false);
     list<CZerocoinSpend> listSpends = walletdb.ListSpentCoins();
     list<CZerocoinSpend> listUnconfirmedSpends;
 
@@ -2667,8 +2664,8 @@ UniValue resetspentzerocoin(const UniValue& params, bool fHelp)
         for (CZerocoinMint mint : listMints) {
             if (mint.GetSerialNumber() == spend.GetSerial()) {
                 mint.SetUsed(false);
-                walletdb.WriteZerocoinMint(mint);
-                walletdb.EraseZerocoinSpendSerialEntry(spend.GetSerial());
+                pwalletMain->WriteZerocoinMint(mint);
+                pwalletMain->EraseZerocoinSpendSerialEntry(spend.GetSerial());
                 RemoveSerialFromDB(spend.GetSerial());
                 UniValue obj(UniValue::VOBJ);
                 obj.push_back(Pair("serial", spend.GetSerial().GetHex()));
@@ -2739,13 +2736,11 @@ UniValue exportzerocoins(const UniValue& params, bool fHelp)
     if (pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-
     bool fIncludeSpent = params[0].get_bool();
     libzerocoin::CoinDenomination denomination = libzerocoin::ZQ_ERROR;
     if (params.size() == 2)
         denomination = libzerocoin::IntToZerocoinDenomination(params[1].get_int());
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(!fIncludeSpent, false, false);
+    list<CZerocoinMint> listMints = pwalletMain->ListMintedCoins(!fIncludeSpent, false, false);
 
     UniValue jsonList(UniValue::VARR);
     for (const CZerocoinMint mint : listMints) {
@@ -2792,7 +2787,6 @@ UniValue importzerocoins(const UniValue& params, bool fHelp)
 
     RPCTypeCheck(params, list_of(UniValue::VARR)(UniValue::VOBJ));
     UniValue arrMints = params[0].get_array();
-    CWalletDB walletdb(pwalletMain->strWalletFile);
 
     int count = 0;
     CAmount nValue = 0;
@@ -2821,7 +2815,7 @@ UniValue importzerocoins(const UniValue& params, bool fHelp)
         CZerocoinMint mint(denom, bnValue, bnRandom, bnSerial, fUsed);
         mint.SetTxHash(txid);
         mint.SetHeight(nHeight);
-        walletdb.WriteZerocoinMint(mint);
+        pwalletMain->WriteZerocoinMint(mint);
         count++;
         nValue += libzerocoin::ZerocoinDenominationToAmount(denom);
     }
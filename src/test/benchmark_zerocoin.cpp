@@ -11,7 +11,9 @@
  **/
 
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -19,6 +21,8 @@
 #include <exception>
 #include <cstdlib>
 #include <sys/time.h>
+#include "checkqueue.h"
+#include "main.h"
 #include "streams.h"
 #include "libzerocoin/ParamGeneration.h"
 #include "libzerocoin/Denominations.h"
@@ -34,6 +38,7 @@ using namespace libzerocoin;
 #define COLOR_STR_RED     "\033[31m"
 
 #define TESTS_COINS_TO_ACCUMULATE   50
+#define TESTS_MAX_SPENDS_PER_BLOCK  8
 
 // Global test counters
 uint32_t    ggNumTests        = 0;
@@ -369,6 +374,128 @@ Testb_MintAndSpend()
 	return false;
 }
 
+bool
+Testb_ParallelSpendVerify()
+{
+	try {
+		if (ggCoins[0] == NULL) {
+			Testb_MintCoin();
+			if (ggCoins[0] == NULL) {
+				return false;
+			}
+		}
+
+		Accumulator acc(&gg_Params->accumulatorParams,CoinDenomination::ZQ_ONE);
+		for (uint32_t i = 0; i < TESTS_COINS_TO_ACCUMULATE; i++) {
+			acc += ggCoins[i]->getPublicCoin();
+		}
+		boost::shared_ptr<const Accumulator> pacc(new Accumulator(acc));
+
+		// Spend the first coins against the full accumulator
+		vector<boost::shared_ptr<const CoinSpend> > vSpends;
+		for (uint32_t i = 0; i < TESTS_MAX_SPENDS_PER_BLOCK; i++) {
+			Accumulator accEmpty(&gg_Params->accumulatorParams,CoinDenomination::ZQ_ONE);
+			AccumulatorWitness wAcc(gg_Params, accEmpty, ggCoins[i]->getPublicCoin());
+			for (uint32_t j = 0; j < TESTS_COINS_TO_ACCUMULATE; j++) {
+				if (j != i)
+					wAcc += ggCoins[j]->getPublicCoin();
+			}
+			CoinSpend spend(gg_Params, *(ggCoins[i]), acc, 0, wAcc, i);
+			vSpends.push_back(boost::shared_ptr<const CoinSpend>(new CoinSpend(spend)));
+		}
+
+		// Run the spend check queue the same way CheckBlock does, with one worker per core
+		CCheckQueue<CZerocoinSpendCheck> queue(1);
+		boost::thread_group threadGroup;
+		int nThreads = std::max(2, (int)boost::thread::hardware_concurrency());
+		for (int i = 0; i < nThreads - 1; i++)
+			threadGroup.create_thread(boost::bind(&CCheckQueue<CZerocoinSpendCheck>::Thread, &queue));
+
+		bool fResult = true;
+		cout << "\tSPEND VERIFY PER BLOCK (" << nThreads << " threads):" << endl;
+		for (uint32_t nSpends = 1; nSpends <= TESTS_MAX_SPENDS_PER_BLOCK; nSpends *= 2) {
+			timer.start();
+			for (uint32_t i = 0; i < nSpends; i++)
+				fResult &= vSpends[i]->Verify(acc);
+			timer.stop();
+			int nSerial = timer.duration();
+
+			timer.start();
+			{
+				CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+				for (uint32_t i = 0; i < nSpends; i++) {
+					vector<CZerocoinSpendCheck> vChecks;
+					vChecks.push_back(CZerocoinSpendCheck(vSpends[i], pacc, CZerocoinSpendCheck::COMMITMENT_POK, i));
+					vChecks.push_back(CZerocoinSpendCheck(vSpends[i], pacc, CZerocoinSpendCheck::ACCUMULATOR_POK, i));
+					vChecks.push_back(CZerocoinSpendCheck(vSpends[i], pacc, CZerocoinSpendCheck::SERIAL_SOK, i));
+					control.Add(vChecks);
+				}
+				fResult &= control.Wait();
+			}
+			timer.stop();
+
+			cout << "\t\t" << nSpends << " spends: serial " << nSerial << " ms\tqueued " << timer.duration() << " ms" << endl;
+		}
+
+		threadGroup.interrupt_all();
+		threadGroup.join_all();
+
+		return fResult;
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		return false;
+	}
+
+	return false;
+}
+
+bool
+Testb_MultiExp()
+{
+	try {
+		// Products shaped like the accumulator PoK equations: 1312-bit exponents
+		// (s_alpha) mod the accumulator modulus
+		const CBigNum& accModulus = gg_Params->accumulatorParams.accumulatorModulus;
+		const uint32_t nRounds = 20;
+
+		bool fResult = true;
+		cout << "\tMULTI-EXPONENTIATION (" << nRounds << " rounds):" << endl;
+		for (uint32_t nBases = 1; nBases <= 4; nBases++) {
+			vector<CBigNum> bases, exps;
+			for (uint32_t i = 0; i < nBases; i++) {
+				bases.push_back(CBigNum::randBignum(accModulus));
+				exps.push_back(CBigNum::RandKBitBigum(1312));
+			}
+
+			CBigNum separate;
+			timer.start();
+			for (uint32_t n = 0; n < nRounds; n++) {
+				separate = CBigNum(1);
+				for (uint32_t i = 0; i < nBases; i++)
+					separate = separate.mul_mod(bases[i].pow_mod(exps[i], accModulus), accModulus);
+			}
+			timer.stop();
+			int nSeparate = timer.duration();
+
+			CBigNum simultaneous;
+			timer.start();
+			for (uint32_t n = 0; n < nRounds; n++)
+				simultaneous = CBigNum::mul_pow_mod(bases, exps, accModulus);
+			timer.stop();
+
+			fResult &= (separate == simultaneous);
+			cout << "\t\t" << nBases << " bases: pow_mod " << nSeparate << " ms\tmul_pow_mod " << timer.duration() << " ms" << endl;
+		}
+
+		return fResult;
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		return false;
+	}
+
+	return false;
+}
+
 void
 Testb_RunAllTests()
 {
@@ -388,6 +515,8 @@ Testb_RunAllTests()
 	gLogTestResult("coins can be minted", Testb_MintCoin);
 	gLogTestResult("the accumulator works", Testb_Accumulator);
 	gLogTestResult("a minted coin can be spent", Testb_MintAndSpend);
+	gLogTestResult("spends can be verified in parallel", Testb_ParallelSpendVerify);
+	gLogTestResult("multi-exponentiation is faster than separate pow_mod", Testb_MultiExp);
 
 	// Summarize test results
 	if (ggSuccessfulTests < ggNumTests) {
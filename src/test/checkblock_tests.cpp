@@ -10,6 +10,8 @@
 
 #include "clientversion.h"
 #include "main.h"
+#include "pow.h"
+#include "timedata.h"
 #include "utiltime.h"
 
 #include <cstdio>
@@ -66,4 +68,62 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+//a header chain of nBlocks ending at nTipHeight, a block every minute
+static void BuildHeaderChain(std::vector<CBlockIndex>& vChain, std::vector<uint256>& vHashes, int nTipHeight)
+{
+    for (size_t i = 0; i < vChain.size(); i++) {
+        CBlockIndex& index = vChain[i];
+        index.nHeight = nTipHeight - (vChain.size() - 1) + i;
+        index.nVersion = 4;
+        index.nTime = 1520000000 + i * 60;
+        index.pprev = i ? &vChain[i - 1] : NULL;
+        index.nBits = i > 1 ? GetNextWorkRequired(index.pprev, NULL) : 0x1e0fffff;
+        vHashes[i] = uint256(i + 1);
+        index.phashBlock = &vHashes[i];
+    }
+}
+
+BOOST_AUTO_TEST_CASE(header_proof_of_stake)
+{
+    std::vector<CBlockIndex> vChain(30);
+    std::vector<uint256> vHashes(vChain.size());
+    BuildHeaderChain(vChain, vHashes, 100000);
+    CBlockIndex* pindexPrev = &vChain.back();
+    SetMockTime(pindexPrev->nTime + 60);
+
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = pindexPrev->GetBlockHash();
+    header.nTime = pindexPrev->nTime + 60;
+    header.nBits = GetNextWorkRequired(pindexPrev, &header);
+
+    //a staked header holds no proof of work, only its difficulty and time are checked
+    CValidationState state;
+    BOOST_CHECK(ContextualCheckBlockHeader(header, state, pindexPrev));
+
+    int nDoS = 0;
+    header.nBits = pindexPrev->nBits + 1;
+    BOOST_CHECK(!ContextualCheckBlockHeader(header, state, pindexPrev));
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-diffbits");
+
+    header.nTime = GetAdjustedTime() + 181;
+    header.nBits = GetNextWorkRequired(pindexPrev, &header);
+    state = CValidationState();
+    BOOST_CHECK(!ContextualCheckBlockHeader(header, state, pindexPrev));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "time-too-new");
+
+    //before the last PoW block, the header must carry its proof of work
+    BuildHeaderChain(vChain, vHashes, 500);
+    pindexPrev = &vChain.back();
+    header.hashPrevBlock = pindexPrev->GetBlockHash();
+    header.nTime = pindexPrev->nTime + 60;
+    header.nBits = 0x1b00ffff;
+    state = CValidationState();
+    BOOST_CHECK(!ContextualCheckBlockHeader(header, state, pindexPrev));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,188 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "hash.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+//stake inputs of different values, ages and stake modifiers
+static std::vector<CStakeKernelInput> MakeStakeInputs(int nInputs)
+{
+    std::vector<CStakeKernelInput> vInputs;
+    for (int i = 0; i < nInputs; i++) {
+        CStakeKernelInput input;
+        input.prevout = COutPoint(Hash(BEGIN(i), END(i)), i % 3);
+        input.nValueIn = (100 + i) * COIN;
+        input.nTimeBlockFrom = 1500000000 + i * 60;
+        input.nStakeModifier = 0x1234567890abcdefULL + i;
+        input.nStakeModifierHeight = i;
+        input.nStakeModifierTime = input.nTimeBlockFrom;
+        vInputs.push_back(input);
+    }
+    return vInputs;
+}
+
+//the first usable kernel time of an input, searched the way CheckStakeKernelHash does, or 0 if there is none
+static unsigned int SerialKernelTime(const CStakeKernelInput& input, unsigned int nBits, unsigned int nTimeTx, unsigned int nHashDrift, int64_t nMinTime)
+{
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    CDataStream ss(SER_GETHASH, 0);
+    ss << input.nStakeModifier;
+    for (unsigned int i = 0; i < nHashDrift; i++) {
+        unsigned int nTryTime = nTimeTx + nHashDrift - i;
+        if (stakeTargetHit(stakeHash(nTryTime, ss, input.prevout.n, input.prevout.hash, input.nTimeBlockFrom), input.nValueIn, bnTargetPerCoinDay))
+            return nTryTime > nMinTime ? nTryTime : 0;
+    }
+    return 0;
+}
+
+static void CheckSearches(const std::vector<CStakeKernelInput>& vInputs, unsigned int nBits, unsigned int nHashDrift)
+{
+    int nFound = 0;
+    for (unsigned int nTimeTx = 1600000000; nTimeTx < 1600000000 + 20 * nHashDrift; nTimeTx += nHashDrift) {
+        int64_t nMinTime = nTimeTx + nHashDrift / 4;
+        std::vector<unsigned int> vKernelTimes;
+        bool fExpected = false;
+        for (size_t i = 0; i < vInputs.size(); i++) {
+            vKernelTimes.push_back(SerialKernelTime(vInputs[i], nBits, nTimeTx, nHashDrift, nMinTime));
+            fExpected |= vKernelTimes.back() != 0;
+        }
+
+        size_t nIndex = 0;
+        unsigned int nTimeKernel = 0;
+        uint256 hashProofOfStake = 0;
+        bool fFound = FindStakeKernel(vInputs, nBits, nTimeTx, nHashDrift, nMinTime, nIndex, nTimeKernel, hashProofOfStake);
+        BOOST_CHECK_EQUAL(fFound, fExpected);
+        if (!fFound)
+            continue;
+
+        //any input with a kernel may win, but it has to be that input's first usable kernel
+        nFound++;
+        BOOST_CHECK(nIndex < vInputs.size());
+        BOOST_CHECK_EQUAL(nTimeKernel, vKernelTimes[nIndex]);
+        CDataStream ss(SER_GETHASH, 0);
+        ss << vInputs[nIndex].nStakeModifier;
+        BOOST_CHECK(hashProofOfStake == stakeHash(nTimeKernel, ss, vInputs[nIndex].prevout.n, vInputs[nIndex].prevout.hash, vInputs[nIndex].nTimeBlockFrom));
+    }
+    BOOST_CHECK(nFound > 0);
+    BOOST_CHECK(GetStakeKernelHashRate() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_search)
+{
+    //around one kernel per search over 50 inputs of ~100 coins and 45 seconds of drift
+    const unsigned int nBits = 0x1c040000;
+    const unsigned int nHashDrift = 45;
+    std::vector<CStakeKernelInput> vInputs = MakeStakeInputs(50);
+
+    int nStakeThreadsPrev = nStakeThreads;
+    nStakeThreads = 0;
+    CheckSearches(vInputs, nBits, nHashDrift);
+
+    boost::thread_group threadGroup;
+    nStakeThreads = 4;
+    for (int i = 0; i < nStakeThreads - 1; i++)
+        threadGroup.create_thread(&ThreadStakeKernelCheck);
+    CheckSearches(vInputs, nBits, nHashDrift);
+
+    //nothing to find
+    size_t nIndex = 0;
+    unsigned int nTimeKernel = 0;
+    uint256 hashProofOfStake = 0;
+    BOOST_CHECK(!FindStakeKernel(vInputs, 0x03000001, 1600000000, nHashDrift, 0, nIndex, nTimeKernel, hashProofOfStake));
+    BOOST_CHECK(!FindStakeKernel(std::vector<CStakeKernelInput>(), nBits, 1600000000, nHashDrift, 0, nIndex, nTimeKernel, hashProofOfStake));
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nStakeThreads = nStakeThreadsPrev;
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_cache)
+{
+    CBlockIndex* pindexTipPrev = chainActive.Tip();
+
+    //a chain with a new stake modifier every minute, and a fork off it right after the block from
+    const int nBlocks = 200;
+    const int nHeightFrom = 10;
+    CBlockHeader blockFrom;
+    blockFrom.nTime = 1500000000 + nHeightFrom * 60;
+    uint256 hashBlockFrom = blockFrom.GetHash();
+    std::vector<CBlockIndex> vMain(nBlocks), vFork(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        vMain[i].nHeight = vFork[i].nHeight = i;
+        vMain[i].nTime = vFork[i].nTime = 1500000000 + i * 60;
+        vMain[i].pprev = i ? &vMain[i - 1] : NULL;
+        vFork[i].pprev = i > nHeightFrom + 1 ? &vFork[i - 1] : vMain[i].pprev;
+        vMain[i].SetStakeModifier(i, true);
+        vFork[i].SetStakeModifier(1000 + i, true);
+    }
+    vMain[nHeightFrom].phashBlock = &hashBlockFrom;
+    mapBlockIndex[hashBlockFrom] = &vMain[nHeightFrom];
+
+    CTransaction txPrev;
+    CMutableTransaction txPrevMutable;
+    txPrevMutable.vout.resize(1);
+    txPrevMutable.vout[0].nValue = 100 * COIN;
+    txPrev = txPrevMutable;
+    COutPoint prevout(txPrev.GetHash(), 0);
+    unsigned int nTimeTx = vMain[nBlocks - 1].nTime;
+
+    chainActive.SetTip(&vMain[nBlocks - 1]);
+    CStakeKernelInput input;
+    BOOST_CHECK(GetStakeKernelInput(blockFrom, txPrev, prevout, nTimeTx, input));
+    int nHeightModifier = input.nStakeModifierHeight;
+    BOOST_CHECK(nHeightModifier > nHeightFrom + 1 && nHeightModifier < nBlocks);
+    BOOST_CHECK_EQUAL(input.nStakeModifier, vMain[nHeightModifier].nStakeModifier);
+    BOOST_CHECK_EQUAL(input.nStakeModifierTime, vMain[nHeightModifier].GetBlockTime());
+
+    //the second lookup is answered from the cache
+    CStakeKernelInput inputCached;
+    BOOST_CHECK(GetStakeKernelInput(blockFrom, txPrev, prevout, nTimeTx, inputCached));
+    BOOST_CHECK_EQUAL(inputCached.nStakeModifier, input.nStakeModifier);
+    BOOST_CHECK_EQUAL(inputCached.nStakeModifierHeight, nHeightModifier);
+
+    //after a reorg the modifier comes from the new chain, and back again
+    chainActive.SetTip(&vFork[nBlocks - 1]);
+    BOOST_CHECK(GetStakeKernelInput(blockFrom, txPrev, prevout, nTimeTx, input));
+    BOOST_CHECK_EQUAL(input.nStakeModifierHeight, nHeightModifier);
+    BOOST_CHECK_EQUAL(input.nStakeModifier, vFork[nHeightModifier].nStakeModifier);
+
+    chainActive.SetTip(&vMain[nBlocks - 1]);
+    BOOST_CHECK(GetStakeKernelInput(blockFrom, txPrev, prevout, nTimeTx, input));
+    BOOST_CHECK_EQUAL(input.nStakeModifier, vMain[nHeightModifier].nStakeModifier);
+
+    //the kernel check from the index entry agrees with the one from the block and the transaction, about half of them hit
+    int nHits = 0;
+    for (unsigned int nTime = nTimeTx; nTime < nTimeTx + 100; nTime++) {
+        uint256 hashBlockCheck, hashIndexCheck;
+        unsigned int nTimeCheck = nTime;
+        bool fHit = CheckStakeKernelHash(0x1d200000, blockFrom, txPrev, prevout, nTimeCheck, 0, true, hashBlockCheck);
+        BOOST_CHECK_EQUAL(CheckStakeKernelHash(0x1d200000, &vMain[nHeightFrom], txPrev.vout[0].nValue, prevout, nTime, hashIndexCheck), fHit);
+        BOOST_CHECK(hashIndexCheck == hashBlockCheck);
+        nHits += fHit;
+    }
+    BOOST_CHECK(nHits > 0 && nHits < 100);
+
+    mapBlockIndex.erase(hashBlockFrom);
+    chainActive.SetTip(pindexTipPrev);
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_hasher)
+{
+    std::vector<CStakeKernelInput> vInputs = MakeStakeInputs(20);
+    BOOST_FOREACH (const CStakeKernelInput& input, vInputs) {
+        CStakeKernelHasher hasher(input.nStakeModifier, input.nTimeBlockFrom, input.prevout.n, input.prevout.hash);
+        CDataStream ss(SER_GETHASH, 0);
+        ss << input.nStakeModifier;
+        for (unsigned int nTimeTx = 1600000000; nTimeTx < 1600000100; nTimeTx++)
+            BOOST_CHECK(hasher.GetHash(nTimeTx) == stakeHash(nTimeTx, ss, input.prevout.n, input.prevout.hash, input.nTimeBlockFrom));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
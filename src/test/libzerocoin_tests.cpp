@@ -196,6 +196,85 @@ Test_ParamGen()
 	return result;
 }
 
+bool
+Test_FixedBaseExp()
+{
+	// The precomputed tables must agree with pow_mod for every exponent size,
+	// including negative exponents and ones wider than the table
+	const IntegerGroupParams* groups[] = {&g_Params->coinCommitmentGroup, &g_Params->serialNumberSoKCommitmentGroup,
+	                                      &g_Params->accumulatorParams.accumulatorPoKCommitmentGroup};
+	const uint32_t expBits[] = {1, 8, 256, 1024, 2048, 4096};
+
+	try {
+		for (const IntegerGroupParams* group : groups) {
+			for (uint32_t bits : expBits) {
+				CBigNum e = CBigNum::RandKBitBigum(bits);
+				if (group->gPow(e, group->modulus) != group->g.pow_mod(e, group->modulus) ||
+				    group->hPow(-e, group->modulus) != group->h.pow_mod(-e, group->modulus)) {
+					return false;
+				}
+			}
+			if (!group->gPow(CBigNum(0), group->modulus).isOne()) {
+				return false;
+			}
+		}
+
+		// The QRN group shares the accumulator modulus
+		const IntegerGroupParams& qrnGroup = g_Params->accumulatorParams.accumulatorQRNCommitmentGroup;
+		const CBigNum& accModulus = g_Params->accumulatorParams.accumulatorModulus;
+		CBigNum e = CBigNum::RandKBitBigum(3000);
+		if (qrnGroup.hPow(-e, accModulus) != qrnGroup.h.inverse(accModulus).pow_mod(e, accModulus)) {
+			return false;
+		}
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool
+Test_MultiExp()
+{
+	// A simultaneous multi-exponentiation must agree with the product of the
+	// individual pow_mod results, for negative and zero exponents too
+	const CBigNum& accModulus = g_Params->accumulatorParams.accumulatorModulus;
+	const IntegerGroupParams& qrnGroup = g_Params->accumulatorParams.accumulatorQRNCommitmentGroup;
+	const uint32_t expBits[] = {1, 256, 1312, 3000};
+
+	try {
+		for (uint32_t nBases = 0; nBases <= 4; nBases++) {
+			vector<CBigNum> bases, exps;
+			CBigNum expected = CBigNum(1);
+			for (uint32_t i = 0; i < nBases; i++) {
+				CBigNum base = CBigNum::randBignum(accModulus);
+				CBigNum e = CBigNum::RandKBitBigum(expBits[i]);
+				if (i % 2) {
+					// Only invertible bases can take a negative exponent
+					base = qrnGroup.g.pow_mod(CBigNum::RandKBitBigum(256), accModulus);
+					e = -e;
+				}
+				bases.push_back(base);
+				exps.push_back(e);
+				expected = expected.mul_mod(base.pow_mod(e, accModulus), accModulus);
+			}
+			if (CBigNum::mul_pow_mod(bases, exps, accModulus) != expected) {
+				return false;
+			}
+		}
+
+		if (!CBigNum::mul_pow_mod({qrnGroup.g, qrnGroup.h}, {CBigNum(0), CBigNum(0)}, accModulus).isOne()) {
+			return false;
+		}
+	} catch (runtime_error &e) {
+		cout << e.what() << endl;
+		return false;
+	}
+
+	return true;
+}
+
 bool
 Test_Accumulator()
 {
@@ -458,6 +537,8 @@ Test_RunAllTests()
 	LogTestResult("parameter sizes are correct", Test_CalcParamSizes);
 	LogTestResult("group/field parameters can be generated", Test_GenerateGroupParams);
 	LogTestResult("parameter generation is correct", Test_ParamGen);
+	LogTestResult("fixed-base exponentiation matches pow_mod", Test_FixedBaseExp);
+	LogTestResult("multi-exponentiation matches pow_mod", Test_MultiExp);
 	LogTestResult("coins can be minted", Test_MintCoin);
 	LogTestResult("invalid coins will be rejected", Test_InvalidCoin);
 	LogTestResult("the accumulator works", Test_Accumulator);
@@ -6,6 +6,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/transaction.h"
+#include "clientversion.h"
 #include "main.h"
 
 #include <boost/test/unit_test.hpp>
@@ -49,4 +50,64 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     // BOOST_CHECK(nSum == 19626072100000000ULL);
 }
 
+//a staked block of nTx transactions, so that reading it back skips the proof of work check
+static CBlock StakedBlock(int nTx)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1520000000;
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(uint256(i + 1), i % 4);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i % 256);
+        tx.vout.resize(2);
+        tx.vout[0].SetEmpty();
+        tx.vout[1].nValue = i * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(tx);
+    }
+    block.vchBlockSig.resize(72, 1);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(raw_block_from_disk)
+{
+    CBlock block = StakedBlock(10);
+    BOOST_REQUIRE(block.IsProofOfStake());
+    CDiskBlockPos pos(99, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+
+    //the bytes on disk are the block's network serialization
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(ReadRawBlockFromDisk(ssBlock, pos, block.GetHash()));
+    CDataStream ssExpected(SER_NETWORK, PROTOCOL_VERSION);
+    ssExpected << block;
+    BOOST_CHECK(ssBlock.str() == ssExpected.str());
+
+    CBlock blockRead;
+    ssBlock >> blockRead;
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+
+    //not the block asked for, or not where a block starts
+    CDataStream ssOther(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!ReadRawBlockFromDisk(ssOther, pos, uint256(1)));
+    BOOST_CHECK(!ReadRawBlockFromDisk(ssOther, CDiskBlockPos(99, pos.nPos + 1), block.GetHash()));
+    BOOST_CHECK(!ReadRawBlockFromDisk(ssOther, CDiskBlockPos(99, 0), block.GetHash()));
+
+    //the block behind another network's magic, or behind a size no block can have
+    const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    const unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    {
+        CAutoFile fileout(OpenBlockFile(CDiskBlockPos(98, 0)), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        MessageStartChars pchOtherMagic = {0x01, 0x02, 0x03, 0x04};
+        fileout << FLATDATA(pchOtherMagic) << nBlockSize << block;
+        fileout << FLATDATA(Params().MessageStart()) << (MAX_BLOCK_SIZE_CURRENT + 1) << block;
+    }
+    BOOST_CHECK(!ReadRawBlockFromDisk(ssOther, CDiskBlockPos(98, nHeaderSize), block.GetHash()));
+    BOOST_CHECK(!ReadRawBlockFromDisk(ssOther, CDiskBlockPos(98, 2 * nHeaderSize + nBlockSize), block.GetHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
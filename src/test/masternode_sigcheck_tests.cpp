@@ -0,0 +1,142 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-sigcheck.h"
+#include "hash.h"
+#include "key.h"
+#include "masternode.h"
+#include "obfuscation.h"
+#include "utiltime.h"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_sigcheck_tests)
+
+//signed without CMasternodeBroadcast::Sign(), which checks the signature it made and so caches it
+static CMasternodeBroadcast SignedBroadcast(int n, CKey& key)
+{
+    CTxIn vin(COutPoint(Hash(BEGIN(n), END(n)), 0));
+    CMasternodeBroadcast mnb(CService("10.0.0.1", 1 + n % 65535), vin, key.GetPubKey(), key.GetPubKey(), PROTOCOL_VERSION);
+    mnb.sigTime = n;
+
+    std::string vchPubKey(mnb.pubKeyCollateralAddress.begin(), mnb.pubKeyCollateralAddress.end());
+    std::string strMessage = mnb.addr.ToString() + boost::lexical_cast<std::string>(mnb.sigTime) + vchPubKey + vchPubKey + boost::lexical_cast<std::string>(mnb.protocolVersion);
+    std::string errorMessage;
+    BOOST_CHECK(obfuScationSigner.SignMessage(strMessage, errorMessage, mnb.sig, key));
+    return mnb;
+}
+
+static CMasternodePing SignedPing(const CTxIn& vin, int n, CKey& key)
+{
+    CMasternodePing mnp;
+    mnp.vin = vin;
+    mnp.blockHash = Hash(BEGIN(n), END(n));
+    mnp.sigTime = n;
+
+    std::string strMessage = mnp.vin.ToString() + mnp.blockHash.ToString() + boost::lexical_cast<std::string>(mnp.sigTime);
+    std::string errorMessage;
+    BOOST_CHECK(obfuScationSigner.SignMessage(strMessage, errorMessage, mnp.vchSig, key));
+    return mnp;
+}
+
+template <typename T>
+static bool QueueMessage(const std::string& strCommand, const T& msg)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << msg;
+    return QueueMasternodeSigCheck(strCommand, ss, false);
+}
+
+static bool QueueBroadcast(const CMasternodeBroadcast& mnb)
+{
+    return QueueMessage("mnb", mnb);
+}
+
+static void WaitForSigChecks()
+{
+    while (MasternodeSigChecksPending() > 0)
+        MilliSleep(1);
+}
+
+BOOST_AUTO_TEST_CASE(sigcheck_queue)
+{
+    boost::thread_group threadGroup;
+    CKey key, keyUnsigned;
+    key.MakeNewKey(true);
+    keyUnsigned.MakeNewKey(true);
+
+    //nothing is checked yet, so the queue fills up and then refuses more
+    for (unsigned int i = 0; i < MAX_MASTERNODE_SIGCHECK_QUEUE; i++) {
+        CMasternodeBroadcast mnb(CService("10.0.0.2", 1), CTxIn(), keyUnsigned.GetPubKey(), keyUnsigned.GetPubKey(), PROTOCOL_VERSION);
+        mnb.sigTime = i;
+        BOOST_CHECK(QueueBroadcast(mnb));
+    }
+    BOOST_CHECK_EQUAL(MasternodeSigChecksPending(), MAX_MASTERNODE_SIGCHECK_QUEUE);
+    CMasternodeBroadcast mnb = SignedBroadcast(0, key);
+    BOOST_CHECK(!QueueBroadcast(mnb));
+
+    StartMasternodeSigChecks(threadGroup, 2);
+    WaitForSigChecks();
+
+    //a message is queued once while its check is pending
+    BOOST_CHECK(QueueBroadcast(mnb));
+    BOOST_CHECK(QueueBroadcast(mnb));
+    BOOST_CHECK(MasternodeSigChecksPending() <= 1);
+    WaitForSigChecks();
+    BOOST_CHECK(mnb.VerifySignature());
+
+    //other and malformed messages are left to the message handler
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnb;
+    BOOST_CHECK(QueueMasternodeSigCheck("tx", ss, true));
+    ss.resize(ss.size() / 2);
+    BOOST_CHECK(QueueMasternodeSigCheck("mnb", ss, true));
+    BOOST_CHECK_EQUAL(MasternodeSigChecksPending(), 0U);
+
+    //a bad signature is not taken for a good one after its check
+    CMasternodeBroadcast mnbBad = SignedBroadcast(1, key);
+    mnbBad.sigTime++;
+    BOOST_CHECK(QueueBroadcast(mnbBad));
+    WaitForSigChecks();
+    BOOST_CHECK(!mnbBad.VerifySignature());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(sigcheck_ping)
+{
+    boost::thread_group threadGroup;
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    StartMasternodeSigChecks(threadGroup, 2);
+
+    //pings are checked against their masternode's key while the list grows under the checks
+    std::vector<CMasternodePing> vPings;
+    for (int i = 0; i < 200; i++) {
+        CMasternode mn(SignedBroadcast(1000 + i, key));
+        BOOST_CHECK(mnodeman.Add(mn));
+        vPings.push_back(SignedPing(mn.vin, i, i % 2 ? key : keyOther));
+        BOOST_CHECK(QueueMessage("mnp", vPings.back()));
+    }
+
+    //a ping of a masternode we do not know is left to the message handler
+    CMasternodePing mnpUnknown = SignedPing(SignedBroadcast(999, key).vin, 0, key);
+    BOOST_CHECK(QueueMessage("mnp", mnpUnknown));
+    WaitForSigChecks();
+
+    for (unsigned int i = 0; i < vPings.size(); i++) {
+        BOOST_CHECK_EQUAL(vPings[i].VerifySignature(key.GetPubKey()), i % 2 == 1);
+        mnodeman.Remove(vPings[i].vin);
+    }
+    BOOST_CHECK(mnpUnknown.VerifySignature(key.GetPubKey()));
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+#include "hash.h"
+#include "timedata.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternodeman_tests)
+
+//a compressed-looking pubkey that differs for every masternode and key type
+static CPubKey MakeMasternodeKey(int n, char type)
+{
+    uint256 hash = Hash(BEGIN(n), END(n), BEGIN(type), END(type));
+    std::vector<unsigned char> vch(1, 0x02);
+    vch.insert(vch.end(), hash.begin(), hash.end());
+    return CPubKey(vch);
+}
+
+static CMasternode MakeMasternode(int n)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(Hash(BEGIN(n), END(n)), n % 2));
+    mn.pubKeyCollateralAddress = MakeMasternodeKey(n, 'c');
+    mn.pubKeyMasternode = MakeMasternodeKey(n, 'm');
+    return mn;
+}
+
+//add masternodes 0 to nMasternodes - 1 to the list, keeping copies in the order they were added
+static void BuildMasternodeList(CMasternodeMan& man, int nMasternodes, std::vector<CMasternode>& vMasternodes)
+{
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternode mn = MakeMasternode(i);
+        BOOST_CHECK(man.Add(mn));
+        vMasternodes.push_back(mn);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_find)
+{
+    const int nMasternodes = 5000;
+
+    CMasternodeMan man;
+    std::vector<CMasternode> vMasternodes;
+    BuildMasternodeList(man, nMasternodes, vMasternodes);
+    BOOST_CHECK_EQUAL(man.size(), nMasternodes);
+
+    //a second entry for the same collateral is refused
+    CMasternode mnDuplicate = MakeMasternode(7);
+    BOOST_CHECK(!man.Add(mnDuplicate));
+
+    for (int i = 0; i < nMasternodes; i++) {
+        const CMasternode& mn = vMasternodes[i];
+        CMasternode* pmn = man.Find(mn.vin);
+        BOOST_CHECK(pmn && pmn->vin == mn.vin);
+        pmn = man.Find(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+        BOOST_CHECK(pmn && pmn->vin == mn.vin);
+        pmn = man.Find(mn.pubKeyMasternode);
+        BOOST_CHECK(pmn && pmn->vin == mn.vin);
+    }
+    BOOST_CHECK(man.Find(MakeMasternode(nMasternodes).vin) == NULL);
+    BOOST_CHECK(man.Find(MakeMasternodeKey(nMasternodes, 'm')) == NULL);
+
+    //removing entries shifts the ones behind them
+    man.Remove(vMasternodes[0].vin);
+    man.Remove(vMasternodes[nMasternodes / 2].vin);
+    BOOST_CHECK_EQUAL(man.size(), nMasternodes - 2);
+    BOOST_CHECK(man.Find(vMasternodes[0].vin) == NULL);
+    BOOST_CHECK(man.Find(vMasternodes[nMasternodes / 2].pubKeyMasternode) == NULL);
+    for (int i = 1; i < nMasternodes; i += 97) {
+        if (i == nMasternodes / 2)
+            continue;
+        CMasternode* pmn = man.Find(vMasternodes[i].pubKeyMasternode);
+        BOOST_CHECK(pmn && pmn->vin == vMasternodes[i].vin);
+    }
+
+    //keys changed in place
+    CMasternode* pmn = man.Find(vMasternodes[1].vin);
+    BOOST_CHECK(pmn);
+    pmn->pubKeyMasternode = MakeMasternodeKey(1, 'n');
+    man.MarkIndexesDirty();
+    BOOST_CHECK(man.Find(MakeMasternodeKey(1, 'm')) == NULL);
+    pmn = man.Find(MakeMasternodeKey(1, 'n'));
+    BOOST_CHECK(pmn && pmn->vin == vMasternodes[1].vin);
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_rank_cache)
+{
+    CMasternodeMan man;
+    std::vector<CMasternode> vMasternodes;
+    BuildMasternodeList(man, 10, vMasternodes);
+
+    //there is no block at this height, so every score is the same and the ranks follow the list
+    const int64_t nBlockHeight = 1000;
+    for (int i = 0; i < 10; i++) {
+        CMasternode* pmn = man.GetMasternodeByRank(i + 1, nBlockHeight, 0, false);
+        BOOST_CHECK(pmn && pmn->vin == vMasternodes[i].vin);
+    }
+    BOOST_CHECK(man.GetMasternodeByRank(11, nBlockHeight, 0, false) == NULL);
+
+    //the cached scores do not outlive a change to the list
+    man.Remove(vMasternodes[0].vin);
+    CMasternode* pmn = man.GetMasternodeByRank(1, nBlockHeight, 0, false);
+    BOOST_CHECK(pmn && pmn->vin == vMasternodes[1].vin);
+    BOOST_CHECK(man.GetMasternodeByRank(10, nBlockHeight, 0, false) == NULL);
+
+    CMasternode mnNew = MakeMasternode(10);
+    man.Add(mnNew);
+    pmn = man.GetMasternodeByRank(10, nBlockHeight, 0, false);
+    BOOST_CHECK(pmn && pmn->vin == mnNew.vin);
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_check_and_remove)
+{
+    const int nMasternodes = 100;
+
+    CMasternodeMan man;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternode mn = MakeMasternode(i);
+        //every other one has pinged, the rest are dropped by the check
+        if (i % 2) {
+            mn.lastPing.vin = mn.vin;
+            mn.lastPing.sigTime = GetAdjustedTime();
+            mn.unitTest = true;
+        }
+        BOOST_CHECK(man.Add(mn));
+        vMasternodes.push_back(mn);
+    }
+
+    man.CheckAndRemove();
+    BOOST_CHECK_EQUAL(man.size(), nMasternodes / 2);
+    for (int i = 0; i < nMasternodes; i++) {
+        const CMasternode& mn = vMasternodes[i];
+        CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+        if (i % 2) {
+            CMasternode* pmn = man.Find(mn.vin);
+            BOOST_CHECK(pmn && pmn->vin == mn.vin);
+            pmn = man.Find(payee);
+            BOOST_CHECK(pmn && pmn->vin == mn.vin);
+            pmn = man.Find(mn.pubKeyMasternode);
+            BOOST_CHECK(pmn && pmn->vin == mn.vin);
+        } else {
+            BOOST_CHECK(man.Find(mn.vin) == NULL);
+            BOOST_CHECK(man.Find(payee) == NULL);
+            BOOST_CHECK(man.Find(mn.pubKeyMasternode) == NULL);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -99,4 +99,146 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static CMutableTransaction SpendingTx(const uint256& hashPrev, uint32_t n, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout.hash = hashPrev;
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+static std::vector<uint256> AncestorScoreOrder(const CTxMemPool& pool)
+{
+    std::vector<uint256> vOrder;
+    BOOST_FOREACH (const CTxMemPoolEntry* pentry, pool.setAncestorScore)
+        vOrder.push_back(pentry->GetTx().GetHash());
+    return vOrder;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexTest)
+{
+    // A cheap parent with a child paying for both, and an unrelated transaction in between
+    CMutableTransaction txParent = SpendingTx(uint256(1), 0, 33000LL);
+    CMutableTransaction txChild = SpendingTx(txParent.GetHash(), 0, 11000LL);
+    CMutableTransaction txOther = SpendingTx(uint256(2), 0, 22000LL);
+    const uint256 hashParent = txParent.GetHash(), hashChild = txChild.GetHash(), hashOther = txOther.GetHash();
+
+    CTxMemPool testPool(CFeeRate(0));
+    LOCK(testPool.cs);
+    testPool.addUnchecked(hashParent, CTxMemPoolEntry(txParent, 1000, 0, 0.0, 1));
+    testPool.addUnchecked(hashChild, CTxMemPoolEntry(txChild, 20000, 0, 0.0, 1));
+    testPool.addUnchecked(hashOther, CTxMemPoolEntry(txOther, 5000, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& entryParent = testPool.mapTx[hashParent];
+    const CTxMemPoolEntry& entryChild = testPool.mapTx[hashChild];
+    BOOST_CHECK_EQUAL(entryParent.GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(entryChild.GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(entryChild.GetSizeWithAncestors(), entryParent.GetTxSize() + entryChild.GetTxSize());
+    BOOST_CHECK_EQUAL(entryChild.GetModFeesWithAncestors(), 21000);
+    BOOST_CHECK(testPool.GetMemPoolParents(hashChild).count(hashParent));
+    BOOST_CHECK(testPool.GetMemPoolChildren(hashParent).count(hashChild));
+
+    // The child's package scores above the other transaction, which scores above the parent alone
+    std::vector<uint256> vOrder = AncestorScoreOrder(testPool);
+    BOOST_REQUIRE_EQUAL(vOrder.size(), 3);
+    BOOST_CHECK(vOrder[0] == hashChild);
+    BOOST_CHECK(vOrder[1] == hashOther);
+    BOOST_CHECK(vOrder[2] == hashParent);
+
+    // Prioritising the parent carries over to the child's package
+    testPool.PrioritiseTransaction(hashParent, hashParent.ToString(), 0, 100000);
+    BOOST_CHECK_EQUAL(entryParent.GetModifiedFee(), 101000);
+    BOOST_CHECK_EQUAL(entryChild.GetModFeesWithAncestors(), 121000);
+    BOOST_CHECK(AncestorScoreOrder(testPool)[0] == hashParent);
+    testPool.ClearPrioritisation(hashParent);
+    BOOST_CHECK_EQUAL(entryChild.GetModFeesWithAncestors(), 21000);
+    BOOST_CHECK(AncestorScoreOrder(testPool) == vOrder);
+
+    // The parent going into a block leaves the child on its own
+    std::list<CTransaction> removed;
+    testPool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    const CTxMemPoolEntry& entryChildAlone = testPool.mapTx[hashChild];
+    BOOST_CHECK_EQUAL(entryChildAlone.GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(entryChildAlone.GetModFeesWithAncestors(), 20000);
+    BOOST_CHECK(testPool.GetMemPoolParents(hashChild).empty());
+    BOOST_CHECK_EQUAL(testPool.setAncestorScore.size(), 2);
+
+    // ... and coming back from a disconnected block it is linked to the child again
+    testPool.addUnchecked(hashParent, CTxMemPoolEntry(txParent, 1000, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashChild].GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashChild].GetModFeesWithAncestors(), 21000);
+    BOOST_CHECK(AncestorScoreOrder(testPool) == vOrder);
+
+    testPool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(testPool.setAncestorScore.size(), 1);
+    testPool.clear();
+    BOOST_CHECK(testPool.setAncestorScore.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolChainLimitsTest)
+{
+    // A chain of five transactions, each spending the one before
+    CTxMemPool testPool(CFeeRate(0));
+    LOCK(testPool.cs);
+    std::vector<CMutableTransaction> vChain;
+    uint256 hashPrev = uint256(3);
+    for (int i = 0; i < 5; i++) {
+        vChain.push_back(SpendingTx(hashPrev, 0, 10000LL));
+        hashPrev = vChain.back().GetHash();
+        testPool.addUnchecked(hashPrev, CTxMemPoolEntry(vChain.back(), 1000 * (i + 1), 0, 0.0, 1));
+    }
+    const uint64_t nTxSize = testPool.mapTx[hashPrev].GetTxSize();
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[0].GetHash()].GetCountWithDescendants(), 5);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[0].GetHash()].GetSizeWithDescendants(), 5 * nTxSize);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[2].GetHash()].GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetCountWithAncestors(), 5);
+
+    // A sixth transaction fits the chain limits only if they leave room for it
+    CMutableTransaction txNext = SpendingTx(hashPrev, 0, 10000LL);
+    std::set<uint256> setAncestors;
+    std::string errString;
+    BOOST_CHECK(testPool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 6 * nTxSize, 6, 6 * nTxSize, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 5);
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(txNext, setAncestors, 5, 6 * nTxSize, 6, 6 * nTxSize, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 5 * nTxSize, 6, 6 * nTxSize, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 6 * nTxSize, 5, 6 * nTxSize, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!testPool.CalculateMemPoolAncestors(txNext, setAncestors, 6, 6 * nTxSize, 6, 5 * nTxSize, errString));
+
+    // The first transaction going into a block is taken out of the others' ancestors
+    std::list<CTransaction> removed;
+    testPool.remove(vChain[0], removed, false);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetCountWithAncestors(), 4);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetSizeWithAncestors(), 4 * nTxSize);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetModFeesWithAncestors(), 14000);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[1].GetHash()].GetCountWithDescendants(), 4);
+
+    // Cutting the chain in two leaves two shorter chains, which join again when it comes back
+    testPool.remove(vChain[2], removed, false);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[1].GetHash()].GetCountWithDescendants(), 1);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetModFeesWithAncestors(), 9000);
+    testPool.addUnchecked(vChain[2].GetHash(), CTxMemPoolEntry(vChain[2], 3000, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[1].GetHash()].GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetCountWithAncestors(), 4);
+    BOOST_CHECK_EQUAL(testPool.mapTx[hashPrev].GetModFeesWithAncestors(), 14000);
+
+    // Removing the middle of the chain with its descendants leaves the rest on its own
+    testPool.remove(vChain[3], removed, true);
+    BOOST_CHECK_EQUAL(testPool.mapTx.size(), 2);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[1].GetHash()].GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[1].GetHash()].GetSizeWithDescendants(), 2 * nTxSize);
+    BOOST_CHECK_EQUAL(testPool.mapTx[vChain[2].GetHash()].GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(testPool.setAncestorScore.size(), 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for routing received messages between the message handler threads
+//
+
+#include "hash.h"
+#include "main.h"
+#include "net.h"
+#include "protocol.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(msghandler_tests)
+
+static void ReceiveMessage(CNode& node, const char* pszCommand)
+{
+    //every payload is a nonce, enough for pong and ignored by the rest
+    CDataStream vPayload(SER_NETWORK, PROTOCOL_VERSION);
+    vPayload << (uint64_t)1;
+
+    CMessageHeader hdr(pszCommand, vPayload.size());
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream vMsg(SER_NETWORK, PROTOCOL_VERSION);
+    vMsg << hdr;
+    vMsg.write(&vPayload[0], vPayload.size());
+
+    LOCK(node.cs_vRecvMsg);
+    BOOST_CHECK(node.ReceiveMsgBytes(&vMsg[0], vMsg.size()));
+}
+
+static bool Process(CNode& node, bool fWorker, bool& fMoreWork)
+{
+    LOCK(node.cs_vRecvMsg);
+    BOOST_CHECK(ProcessMessages(&node, fWorker, fMoreWork));
+    return !node.fDisconnect;
+}
+
+static uint64_t CountProcessed(const std::string& strCommand)
+{
+    std::map<std::string, CMessageStats> mapStats;
+    GetMessageStats(mapStats);
+    return mapStats.count(strCommand) ? mapStats[strCommand].nCount : 0;
+}
+
+BOOST_AUTO_TEST_CASE(message_class)
+{
+    BOOST_CHECK_EQUAL(GetMessageClass("mnb"), MSG_CLASS_MASTERNODE);
+    BOOST_CHECK_EQUAL(GetMessageClass("mnp"), MSG_CLASS_MASTERNODE);
+    BOOST_CHECK_EQUAL(GetMessageClass("mnw"), MSG_CLASS_MASTERNODE);
+    BOOST_CHECK_EQUAL(GetMessageClass("mvote"), MSG_CLASS_MASTERNODE);
+    BOOST_CHECK_EQUAL(GetMessageClass("fbvote"), MSG_CLASS_MASTERNODE);
+    BOOST_CHECK_EQUAL(GetMessageClass("ix"), MSG_CLASS_SWIFTTX);
+    BOOST_CHECK_EQUAL(GetMessageClass("txlvote"), MSG_CLASS_SWIFTTX);
+    BOOST_CHECK_EQUAL(GetMessageClass("block"), MSG_CLASS_CHAIN);
+    BOOST_CHECK_EQUAL(GetMessageClass("tx"), MSG_CLASS_CHAIN);
+    BOOST_CHECK_EQUAL(GetMessageClass("spork"), MSG_CLASS_CHAIN);
+    BOOST_CHECK_EQUAL(GetMessageClass("dsq"), MSG_CLASS_CHAIN);
+    BOOST_CHECK_EQUAL(GetMessageClass("nosuchcommand"), MSG_CLASS_CHAIN);
+}
+
+BOOST_AUTO_TEST_CASE(per_peer_order)
+{
+    int nWorkersSaved = nMessageHandlerWorkers;
+    nMessageHandlerWorkers = 2;
+
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 1)), "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    ReceiveMessage(node, "mnp");
+    ReceiveMessage(node, "pong");
+    ReceiveMessage(node, "mnw");
+    bool fMoreWork;
+
+    //the main message handler leaves the first message to a worker, and the rest wait for it
+    BOOST_CHECK(Process(node, false, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 3U);
+    BOOST_CHECK(!fMoreWork);
+
+    //the worker stops at the next message that is not its own
+    BOOST_CHECK(Process(node, true, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 2U);
+    BOOST_CHECK(!fMoreWork);
+    BOOST_CHECK(Process(node, true, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 2U);
+
+    BOOST_CHECK(Process(node, false, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    BOOST_CHECK(!fMoreWork);
+
+    //nothing is processed past a pending getdata request, which only the main message handler answers
+    node.vRecvGetData.push_back(CInv(MSG_TX, 0));
+    BOOST_CHECK(Process(node, true, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    node.vRecvGetData.clear();
+
+    BOOST_CHECK(Process(node, true, fMoreWork));
+    BOOST_CHECK(node.vRecvMsg.empty());
+
+    nMessageHandlerWorkers = nWorkersSaved;
+}
+
+BOOST_AUTO_TEST_CASE(main_handler_only)
+{
+    int nWorkersSaved = nMessageHandlerWorkers;
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 2)), "", true);
+    bool fMoreWork;
+
+    //without workers everything goes to the main message handler
+    nMessageHandlerWorkers = 0;
+    node.nVersion = PROTOCOL_VERSION;
+    ReceiveMessage(node, "mnp");
+    ReceiveMessage(node, "pong");
+    BOOST_CHECK(Process(node, true, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 2U);
+    BOOST_CHECK(Process(node, false, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    BOOST_CHECK(fMoreWork);
+    BOOST_CHECK(Process(node, false, fMoreWork));
+    BOOST_CHECK(node.vRecvMsg.empty());
+    BOOST_CHECK(!fMoreWork);
+
+    //and so does everything before the version handshake
+    nMessageHandlerWorkers = 2;
+    node.nVersion = 0;
+    ReceiveMessage(node, "mnp");
+    BOOST_CHECK(Process(node, true, fMoreWork));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    BOOST_CHECK(Process(node, false, fMoreWork));
+    BOOST_CHECK(node.vRecvMsg.empty());
+
+    nMessageHandlerWorkers = nWorkersSaved;
+}
+
+BOOST_AUTO_TEST_CASE(message_stats)
+{
+    int nWorkersSaved = nMessageHandlerWorkers;
+    nMessageHandlerWorkers = 0;
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 3)), "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    bool fMoreWork;
+
+    uint64_t nPong = CountProcessed("pong");
+    uint64_t nOther = CountProcessed("other");
+    ReceiveMessage(node, "pong");
+    ReceiveMessage(node, "pong");
+    ReceiveMessage(node, "nosuchcommand");
+    while (!node.vRecvMsg.empty())
+        BOOST_REQUIRE(Process(node, false, fMoreWork));
+
+    std::map<std::string, CMessageStats> mapStats;
+    GetMessageStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["pong"].nCount, nPong + 2);
+    BOOST_CHECK_EQUAL(mapStats["other"].nCount, nOther + 1);
+    BOOST_CHECK(!mapStats.count("nosuchcommand"));
+    BOOST_CHECK(mapStats["pong"].nMaxTime <= mapStats["pong"].nTotalTime);
+    BOOST_CHECK(mapStats["pong"].nTotalWaitTime >= 0);
+
+    nMessageHandlerWorkers = nWorkersSaved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
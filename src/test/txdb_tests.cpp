@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txdb.h"
+#include "hash.h"
+#include "main.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txdb_tests)
+
+//a chain past the last PoW block, every other block staked, the first one's parent not in the index
+static std::vector<CDiskBlockIndex> BuildBlockIndexChain(int nBlocks)
+{
+    std::vector<CDiskBlockIndex> vChain(nBlocks);
+    uint256 hashPrev = Hash(BEGIN(nBlocks), END(nBlocks));
+    for (int i = 0; i < nBlocks; i++) {
+        CDiskBlockIndex& index = vChain[i];
+        index.nVersion = i % 4 ? 4 : 3;
+        index.nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+        index.nTime = 1500000000 + i * 60;
+        index.nBits = 0x1d00ffff;
+        index.nNonce = i;
+        index.nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_SCRIPTS;
+        index.nTx = 1 + i % 3;
+        index.nDataPos = i;
+        index.nStakeModifier = i;
+        index.nMoneySupply = i * COIN;
+        if (i % 2) {
+            index.nFlags = CBlockIndex::BLOCK_PROOF_OF_STAKE;
+            index.prevoutStake = COutPoint(Hash(BEGIN(i), END(i)), i % 3);
+            index.nStakeTime = index.nTime;
+        }
+        if (i % 4 == 1) {
+            index.SetZerocoinSupply(libzerocoin::ZQ_TEN, i);
+            index.AddMint(libzerocoin::ZQ_TEN);
+        }
+        index.hashPrev = hashPrev;
+        hashPrev = index.GetBlockHash();
+        if (i)
+            vChain[i - 1].hashNext = hashPrev;
+    }
+    return vChain;
+}
+
+static void ClearLoadedIndex()
+{
+    BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex)
+        delete item.second;
+    mapBlockIndex.clear();
+    setStakeSeen.clear();
+}
+
+static void CheckLoadedIndex(const std::vector<CDiskBlockIndex>& vChain)
+{
+    //the chain, plus the entry made for the missing parent
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), vChain.size() + 1);
+    BOOST_CHECK_EQUAL(setStakeSeen.size(), vChain.size() / 2);
+
+    const CBlockIndex* pindexPrev = NULL;
+    for (size_t i = 0; i < vChain.size(); i++) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(vChain[i].GetBlockHash());
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        const CBlockIndex* pindex = mi->second;
+        BOOST_CHECK(pindex->GetBlockHash() == vChain[i].GetBlockHash());
+        BOOST_CHECK_EQUAL(pindex->nHeight, vChain[i].nHeight);
+        BOOST_CHECK_EQUAL(pindex->nTx, vChain[i].nTx);
+        BOOST_CHECK_EQUAL(pindex->nStakeModifier, vChain[i].nStakeModifier);
+        BOOST_CHECK_EQUAL(pindex->IsProofOfStake(), vChain[i].IsProofOfStake());
+        BOOST_CHECK_EQUAL(pindex->GetZerocoinSupply(), vChain[i].GetZerocoinSupply());
+        BOOST_CHECK_EQUAL(pindex->GetMintCount(), vChain[i].GetMintCount());
+        BOOST_REQUIRE(pindex->pprev);
+        BOOST_CHECK(pindex->pprev->GetBlockHash() == vChain[i].hashPrev);
+        if (i) {
+            BOOST_CHECK(pindex->pprev == pindexPrev);
+            BOOST_CHECK(pindexPrev->pnext == pindex);
+        }
+        pindexPrev = pindex;
+    }
+    BOOST_CHECK(pindexPrev->pnext == NULL);
+    BOOST_CHECK(mapBlockIndex[vChain[0].hashPrev]->pprev == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(load_block_index)
+{
+    const std::vector<CDiskBlockIndex> vChain = BuildBlockIndexChain(1000);
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_FOREACH (const CDiskBlockIndex& index, vChain)
+        BOOST_CHECK(db.WriteBlockIndex(index));
+
+    BlockMap mapBlockIndexSaved;
+    std::set<std::pair<COutPoint, unsigned int> > setStakeSeenSaved;
+    mapBlockIndexSaved.swap(mapBlockIndex);
+    setStakeSeenSaved.swap(setStakeSeen);
+
+    //the same index whether it is read by one thread or split over several
+    int vThreads[] = {1, 2, 3, 8};
+    BOOST_FOREACH (int nThreads, vThreads) {
+        BOOST_CHECK(db.LoadBlockIndexGuts(nThreads));
+        CheckLoadedIndex(vChain);
+        ClearLoadedIndex();
+    }
+
+    mapBlockIndexSaved.swap(mapBlockIndex);
+    setStakeSeenSaved.swap(setStakeSeen);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "wallet.h"
+#include "main.h"
 
 #include <set>
 #include <stdint.h>
@@ -305,4 +306,151 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(wallet_utxo_index)
+{
+    bool fFirstRun;
+    CWallet walletUTXO("wallet_utxo_tests.dat");
+    walletUTXO.LoadWallet(fFirstRun);
+    LOCK2(cs_main, walletUTXO.cs_wallet);
+
+    CKey key, keyImported;
+    key.MakeNewKey(true);
+    keyImported.MakeNewKey(true);
+    BOOST_CHECK(walletUTXO.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptImported = GetScriptForDestination(keyImported.GetPubKey().GetID());
+    CScript scriptOther = CScript() << OP_TRUE;
+
+    //two outputs of ours and one that is not
+    CMutableTransaction tx;
+    tx.vout.push_back(CTxOut(1 * COIN, scriptMine));
+    tx.vout.push_back(CTxOut(2 * COIN, scriptOther));
+    tx.vout.push_back(CTxOut(3 * COIN, scriptMine));
+    CWalletTx wtx(&walletUTXO, tx);
+    BOOST_CHECK(walletUTXO.AddToWallet(wtx));
+
+    vector<COutput> vAvailable;
+    walletUTXO.AvailableCoins(vAvailable, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 2);
+
+    //an output spent by a transaction in the mempool is left out, and comes back when that one is dropped
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(wtx.GetHash(), 0));
+    txSpend.vout.push_back(CTxOut(1 * COIN, scriptOther));
+    CWalletTx wtxSpend(&walletUTXO, txSpend);
+    BOOST_CHECK(walletUTXO.AddToWallet(wtxSpend));
+    mempool.addUnchecked(wtxSpend.GetHash(), CTxMemPoolEntry(wtxSpend, 0, 0, 0.0, 1));
+    walletUTXO.AvailableCoins(vAvailable, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 1);
+    BOOST_CHECK_EQUAL(vAvailable[0].i, 2);
+
+    std::list<CTransaction> removed;
+    mempool.remove(wtxSpend, removed);
+    walletUTXO.AvailableCoins(vAvailable, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 2);
+
+    //outputs already in the wallet become ours when their key is added
+    CMutableTransaction txImported;
+    txImported.vout.push_back(CTxOut(4 * COIN, scriptImported));
+    CWalletTx wtxImported(&walletUTXO, txImported);
+    BOOST_CHECK(walletUTXO.AddToWallet(wtxImported));
+    walletUTXO.AvailableCoins(vAvailable, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 2);
+    BOOST_CHECK(walletUTXO.AddKeyPubKey(keyImported, keyImported.GetPubKey()));
+    walletUTXO.AvailableCoins(vAvailable, false);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_balance_cache)
+{
+    bool fFirstRun;
+    CWallet walletBalance("wallet_balance_tests.dat");
+    walletBalance.LoadWallet(fFirstRun);
+    LOCK2(cs_main, walletBalance.cs_wallet);
+
+    CKey key, keyImported;
+    key.MakeNewKey(true);
+    keyImported.MakeNewKey(true);
+    BOOST_CHECK(walletBalance.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptImported = GetScriptForDestination(keyImported.GetPubKey().GetID());
+
+    //neither in the chain nor in the mempool, so it counts for nothing
+    CMutableTransaction tx;
+    tx.vout.push_back(CTxOut(1 * COIN, scriptMine));
+    tx.vout.push_back(CTxOut(3 * COIN, scriptMine));
+    CWalletTx wtx(&walletBalance, tx);
+    BOOST_CHECK(walletBalance.AddToWallet(wtx));
+    BOOST_CHECK_EQUAL(walletBalance.GetBalance(), 0);
+    BOOST_CHECK_EQUAL(walletBalance.GetUnconfirmedBalance(), 0);
+
+    //the cached balances follow the mempool
+    mempool.addUnchecked(wtx.GetHash(), CTxMemPoolEntry(wtx, 0, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(walletBalance.GetUnconfirmedBalance(), 4 * COIN);
+    BOOST_CHECK_EQUAL(walletBalance.GetBalance(), 0);
+
+    //and the keys of the wallet
+    CMutableTransaction txImported;
+    txImported.vout.push_back(CTxOut(5 * COIN, scriptImported));
+    CWalletTx wtxImported(&walletBalance, txImported);
+    BOOST_CHECK(walletBalance.AddToWallet(wtxImported));
+    mempool.addUnchecked(wtxImported.GetHash(), CTxMemPoolEntry(wtxImported, 0, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(walletBalance.GetUnconfirmedBalance(), 4 * COIN);
+    BOOST_CHECK(walletBalance.AddKeyPubKey(keyImported, keyImported.GetPubKey()));
+    BOOST_CHECK_EQUAL(walletBalance.GetUnconfirmedBalance(), 9 * COIN);
+
+    std::list<CTransaction> removed;
+    mempool.remove(wtx, removed);
+    mempool.remove(wtxImported, removed);
+    BOOST_CHECK_EQUAL(walletBalance.GetUnconfirmedBalance(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_zerocoin_mint_store)
+{
+    bool fFirstRun;
+    CWallet walletMints("wallet_zerocoin_tests.dat");
+    walletMints.LoadWallet(fFirstRun);
+
+    std::vector<CZerocoinMint> vMints;
+    for (int i = 1; i <= 3; i++) {
+        CZerocoinMint mint(libzerocoin::ZQ_ONE, CBigNum(1000 + i), CBigNum(2000 + i), CBigNum(3000 + i), false);
+        BOOST_CHECK(walletMints.WriteZerocoinMint(mint));
+        vMints.push_back(mint);
+    }
+    BOOST_CHECK_EQUAL(walletMints.ListMintedCoins(true, false, false).size(), 3);
+    BOOST_CHECK(walletMints.IsMyUnusedZerocoinSerial(vMints[0].GetSerialNumber()));
+    BOOST_CHECK(!walletMints.IsMyUnusedZerocoinSerial(CBigNum(4000)));
+
+    //a recorded spend of its serial marks a mint used the next time the mints are listed
+    CZerocoinSpend spend(vMints[0].GetSerialNumber(), 0, vMints[0].GetValue(), vMints[0].GetDenomination(), 0);
+    BOOST_CHECK(walletMints.WriteZerocoinSpendSerialEntry(spend));
+    BOOST_CHECK(walletMints.IsMyZerocoinSpend(vMints[0].GetSerialNumber()));
+    BOOST_CHECK(!walletMints.IsMyUnusedZerocoinSerial(vMints[0].GetSerialNumber()));
+    BOOST_CHECK_EQUAL(walletMints.ListMintedCoins(true, false, false).size(), 2);
+    CZerocoinMint mintRead;
+    BOOST_CHECK(walletMints.ReadZerocoinMint(vMints[0].GetValue(), mintRead));
+    BOOST_CHECK(mintRead.IsUsed());
+
+    //archived mints leave the store and come back when unarchived
+    BOOST_CHECK(walletMints.ArchiveMintOrphan(vMints[1]));
+    BOOST_CHECK(!walletMints.ReadZerocoinMint(vMints[1].GetValue(), mintRead));
+    BOOST_CHECK(!walletMints.IsMyUnusedZerocoinSerial(vMints[1].GetSerialNumber()));
+    BOOST_CHECK_EQUAL(walletMints.ListMintedCoins(false, false, false).size(), 2);
+    BOOST_CHECK(walletMints.UnarchiveZerocoin(vMints[1]));
+    BOOST_CHECK(walletMints.IsMyUnusedZerocoinSerial(vMints[1].GetSerialNumber()));
+
+    BOOST_CHECK(walletMints.EraseZerocoinMint(vMints[2]));
+    BOOST_CHECK(walletMints.EraseZerocoinSpendSerialEntry(vMints[0].GetSerialNumber()));
+
+    //the store loads with the wallet the way it was written through
+    CWallet walletReloaded("wallet_zerocoin_tests.dat");
+    walletReloaded.LoadWallet(fFirstRun);
+    std::list<CZerocoinMint> listMints = walletReloaded.ListMintedCoins(false, false, false);
+    BOOST_CHECK_EQUAL(listMints.size(), 2);
+    BOOST_CHECK(walletReloaded.ReadZerocoinMint(vMints[0].GetValue(), mintRead) && mintRead.IsUsed());
+    BOOST_CHECK(!walletReloaded.IsMyZerocoinSpend(vMints[0].GetSerialNumber()));
+    BOOST_CHECK(walletReloaded.IsMyUnusedZerocoinSerial(vMints[1].GetSerialNumber()));
+    BOOST_CHECK(!walletReloaded.ReadZerocoinMint(vMints[2].GetValue(), mintRead));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
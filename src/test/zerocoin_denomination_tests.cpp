@@ -495,4 +495,59 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test99)
     nValueTarget += OneCoinAmount;
 }
 
+BOOST_AUTO_TEST_CASE(denomination_index_test)
+{
+    for (int i = 0; i < ZEROCOIN_DENOMINATIONS; i++)
+        BOOST_CHECK_EQUAL(ZerocoinDenominationToIndex(zerocoinDenomList[i]), i);
+    BOOST_CHECK_EQUAL(ZerocoinDenominationToIndex(ZQ_ERROR), -1);
+    BOOST_CHECK_EQUAL(ZerocoinDenominationToIndex(CoinDenomination(2)), -1);
+    BOOST_CHECK_EQUAL((int)zerocoinDenomList.size(), ZEROCOIN_DENOMINATIONS);
+}
+
+//the zerocoin fields of the block index are read from and written to disk as the map and vector they used to be
+BOOST_AUTO_TEST_CASE(block_index_zerocoin_fields_test)
+{
+    CBlockIndex index;
+    index.nVersion = 4;
+    index.SetZerocoinSupply(ZQ_ONE, 7);
+    index.SetZerocoinSupply(ZQ_FIVE_THOUSAND, 3);
+
+    std::map<CoinDenomination, int64_t> mapSupply;
+    for (auto& denom : zerocoinDenomList)
+        mapSupply[denom] = index.GetZerocoinSupply(denom);
+    CDataStream ssOldFields(SER_DISK, CLIENT_VERSION);
+    ssOldFields << mapSupply << std::vector<CoinDenomination>();
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    BOOST_CHECK(ss.size() > ssOldFields.size());
+    BOOST_CHECK(std::equal(ssOldFields.begin(), ssOldFields.end(), ss.end() - ssOldFields.size()));
+    std::string strHeader(ss.begin(), ss.end() - ssOldFields.size());
+
+    //mints in the order of their block, as the vector held them
+    std::vector<CoinDenomination> vMints = {ZQ_TEN, ZQ_ONE, ZQ_TEN, ZQ_FIVE_THOUSAND};
+    CDataStream ssOld(strHeader.data(), strHeader.data() + strHeader.size(), SER_DISK, CLIENT_VERSION);
+    ssOld << mapSupply << vMints;
+    CDiskBlockIndex diskindex;
+    ssOld >> diskindex;
+    BOOST_CHECK_EQUAL(diskindex.GetZerocoinSupply(ZQ_ONE), 7);
+    BOOST_CHECK_EQUAL(diskindex.GetZerocoinSupply(ZQ_FIVE), 0);
+    BOOST_CHECK_EQUAL(diskindex.GetZerocoinSupply(ZQ_FIVE_THOUSAND), 3);
+    BOOST_CHECK_EQUAL(diskindex.GetZerocoinSupply(), 7 * COIN + 3 * 5000 * COIN);
+    BOOST_CHECK_EQUAL(diskindex.GetMintCount(), 4);
+    BOOST_CHECK_EQUAL(diskindex.GetMintCount(ZQ_TEN), 2);
+    BOOST_CHECK_EQUAL(diskindex.GetMintCount(ZQ_ONE), 1);
+    BOOST_CHECK(diskindex.MintedDenomination(ZQ_FIVE_THOUSAND));
+    BOOST_CHECK(!diskindex.MintedDenomination(ZQ_FIFTY));
+
+    //written back, the mints come out grouped by denomination, which is all anything reads from them
+    CDataStream ssNew(SER_DISK, CLIENT_VERSION);
+    ssNew << diskindex;
+    CDataStream ssGrouped(strHeader.data(), strHeader.data() + strHeader.size(), SER_DISK, CLIENT_VERSION);
+    ssGrouped << mapSupply << std::vector<CoinDenomination>({ZQ_ONE, ZQ_TEN, ZQ_TEN, ZQ_FIVE_THOUSAND});
+    BOOST_CHECK(std::string(ssNew.begin(), ssNew.end()) == std::string(ssGrouped.begin(), ssGrouped.end()));
+
+    BOOST_CHECK_THROW(index.GetZerocoinSupply(ZQ_ERROR), std::out_of_range);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
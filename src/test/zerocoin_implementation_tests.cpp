@@ -10,6 +10,7 @@
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 #include <accumulators.h>
+#include "zerocoinspendcache.h"
 
 using namespace libzerocoin;
 
@@ -224,6 +225,12 @@ BOOST_AUTO_TEST_CASE(checkzerocoinspend_test)
     BOOST_CHECK_MESSAGE(denom == pubCoin.getDenomination(), "Spend denomination must match original pubCoin");
     BOOST_CHECK_MESSAGE(coinSpend.Verify(accumulator), "CoinSpend object failed to validate");
 
+    //a verified spend is only cached for the accumulator value it was verified against
+    BOOST_CHECK_MESSAGE(!IsZerocoinSpendVerified(coinSpend, accumulator.getValue()), "CoinSpend is in the spend cache before being verified");
+    SetZerocoinSpendVerified(coinSpend, accumulator.getValue());
+    BOOST_CHECK_MESSAGE(IsZerocoinSpendVerified(coinSpend, accumulator.getValue()), "CoinSpend is missing from the spend cache");
+    BOOST_CHECK_MESSAGE(!IsZerocoinSpendVerified(coinSpend, accumulator.getValue() + 1), "CoinSpend hit the spend cache with another accumulator");
+
     //serialize the spend
     CDataStream serializedCoinSpend2(SER_NETWORK, PROTOCOL_VERSION);
     serializedCoinSpend2 << coinSpend;
@@ -348,5 +355,43 @@ BOOST_AUTO_TEST_CASE(checksum_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(mintindex_test)
+{
+    cout << "Running mintindex_test...\n";
+
+    CZerocoinDB db(1 << 20, true);
+
+    CZerocoinMintIndexEntry mintOne;
+    mintOne.bnValue = CBigNum(rawTxpub1);
+    mintOne.hashTx = uint256(1);
+    mintOne.nOut = 1;
+    mintOne.vPrevouts.push_back(COutPoint(uint256(2), 0));
+    CZerocoinMintIndexEntry mintFive = mintOne;
+    mintFive.nOut = 2;
+
+    std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> > mapMints;
+    mapMints[CoinDenomination::ZQ_ONE].push_back(mintOne);
+    mapMints[CoinDenomination::ZQ_FIVE].push_back(mintFive);
+    BOOST_CHECK(db.WriteBlockMints(100, uint256(3), mapMints));
+
+    uint256 hashBlock;
+    std::vector<CZerocoinMintIndexEntry> vMints;
+    BOOST_CHECK(db.ReadBlockMints(CoinDenomination::ZQ_ONE, 100, hashBlock, vMints));
+    BOOST_CHECK(hashBlock == uint256(3));
+    BOOST_CHECK(vMints.size() == 1 && vMints[0].bnValue == mintOne.bnValue && vMints[0].nOut == 1);
+    BOOST_CHECK(vMints[0].vPrevouts.size() == 1 && vMints[0].vPrevouts[0] == COutPoint(uint256(2), 0));
+    BOOST_CHECK(IsValidMintIndexEntry(vMints[0]));
+    BOOST_CHECK(!db.ReadBlockMints(CoinDenomination::ZQ_TEN, 100, hashBlock, vMints));
+    BOOST_CHECK(!db.ReadBlockMints(CoinDenomination::ZQ_ONE, 101, hashBlock, vMints));
+
+    //a block replacing this height clears the denominations it does not mint
+    mapMints.erase(CoinDenomination::ZQ_FIVE);
+    BOOST_CHECK(db.WriteBlockMints(100, uint256(4), mapMints));
+    BOOST_CHECK(!db.ReadBlockMints(CoinDenomination::ZQ_FIVE, 100, hashBlock, vMints));
+    BOOST_CHECK(db.ReadBlockMints(CoinDenomination::ZQ_ONE, 100, hashBlock, vMints) && hashBlock == uint256(4));
+
+    BOOST_CHECK(db.EraseBlockMints(100));
+    BOOST_CHECK(!db.ReadBlockMints(CoinDenomination::ZQ_ONE, 100, hashBlock, vMints));
+}
 
 BOOST_AUTO_TEST_SUITE_END()
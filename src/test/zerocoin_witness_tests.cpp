@@ -0,0 +1,306 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "accumulators.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "txdb.h"
+#include "wallet.h"
+#include "walletdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace libzerocoin;
+
+extern CWallet* pwalletMain;
+extern std::string rawTxpub1;
+extern std::string rawTxRand1;
+extern std::string rawTxSerial1;
+
+//the test chain has a mint of the coin's denomination every ten blocks from FIRST_MINT_HEIGHT, and the coin
+//itself next to one of them at COIN_MINT_HEIGHT
+static const int FIRST_MINT_HEIGHT = 1652;
+static const int COIN_MINT_HEIGHT = 1702;
+static const int COIN_ACC_START_HEIGHT = COIN_MINT_HEIGHT - COIN_MINT_HEIGHT % 10;
+static const int CHAIN_HEIGHT = 2760;
+static const int WITNESS_STOP_HEIGHT = CHAIN_HEIGHT - CHAIN_HEIGHT % 10 - 20;
+
+//the checkpoint of a block: the one before it, or every ten blocks the one before with the mints of the blocks
+//twenty to eleven blocks back added, its value stored in zerocoinDB
+static uint256 MakeAccumulatorCheckpoint(const CBlockIndex* pindex)
+{
+    const CBlockIndex* pindexPrev = pindex->pprev;
+    if (pindex->nHeight % 10 || pindex->nHeight < GetZerocoinStartHeight())
+        return pindexPrev->nAccumulatorCheckpoint;
+
+    Accumulator accumulator(Params().Zerocoin_Params(), ZQ_ONE);
+    CBigNum bnValue = 0;
+    if (pindexPrev->nAccumulatorCheckpoint != 0 && GetAccumulatorValueFromDB(pindexPrev->nAccumulatorCheckpoint, ZQ_ONE, bnValue))
+        accumulator.setValue(bnValue);
+
+    for (const CBlockIndex* p = pindexPrev; p->nHeight >= pindex->nHeight - 20; p = p->pprev) {
+        uint256 hashBlock;
+        std::vector<CZerocoinMintIndexEntry> vMints;
+        if (p->nHeight >= pindex->nHeight - 10 || !zerocoinDB->ReadBlockMints(ZQ_ONE, p->nHeight, hashBlock, vMints))
+            continue;
+        BOOST_FOREACH (const CZerocoinMintIndexEntry& mint, vMints)
+            accumulator.increment(mint.bnValue);
+    }
+
+    uint32_t nChecksum = GetChecksum(accumulator.getValue());
+    zerocoinDB->WriteAccumulatorValue(nChecksum, accumulator.getValue());
+
+    uint256 nCheckpoint = 0;
+    BOOST_FOREACH (CoinDenomination denom, zerocoinDenomList)
+        nCheckpoint = nCheckpoint << 32 | (denom == ZQ_ONE ? nChecksum : 0);
+    return nCheckpoint;
+}
+
+//build on pindexFork up to CHAIN_HEIGHT with block hashes and mints of their own for each branch, and make it the active chain
+static void ExtendMintChain(CBlockIndex* pindexFork, int nBranch, const CBlock& blockCoin, const CBigNum& bnCoin, std::vector<CBlockIndex*>& vIndexAdded)
+{
+    CBlockIndex* pindexPrev = pindexFork;
+    for (int nHeight = pindexFork->nHeight + 1; nHeight <= CHAIN_HEIGHT; nHeight++) {
+        uint256 hashBlock = nHeight == COIN_MINT_HEIGHT ? blockCoin.GetHash() : Hash(BEGIN(nBranch), END(nBranch), BEGIN(nHeight), END(nHeight));
+        CBlockIndex* pindex = new CBlockIndex();
+        pindex->nHeight = nHeight;
+        pindex->pprev = pindexPrev;
+        pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(hashBlock, pindex)).first->first;
+        vIndexAdded.push_back(pindex);
+
+        std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> > mapMints;
+        if (nHeight >= FIRST_MINT_HEIGHT && nHeight % 10 == 2) {
+            CZerocoinMintIndexEntry mint;
+            mint.bnValue = CBigNum::randBignum(Params().Zerocoin_Params()->coinCommitmentGroup.modulus);
+            mint.hashTx = Hash(BEGIN(hashBlock), END(hashBlock));
+            mint.nOut = 0;
+            mapMints[ZQ_ONE].push_back(mint);
+            if (nHeight == COIN_MINT_HEIGHT) {
+                mint.bnValue = bnCoin;
+                mint.hashTx = blockCoin.vtx[0].GetHash();
+                mapMints[ZQ_ONE].push_back(mint);
+            }
+            for (unsigned int i = 0; i < mapMints[ZQ_ONE].size(); i++)
+                pindex->AddMint(ZQ_ONE);
+            BOOST_REQUIRE(zerocoinDB->WriteBlockMints(nHeight, hashBlock, mapMints));
+        }
+
+        pindex->nAccumulatorCheckpoint = MakeAccumulatorCheckpoint(pindex);
+        pindexPrev = pindex;
+    }
+    chainActive.SetTip(pindexPrev);
+}
+
+//a witness built from scratch for a spend that adds every checkpoint
+static void GenerateFullWitness(const PublicCoin& coin, CBigNum& bnWitness, int& nMintsAdded)
+{
+    Accumulator accumulator(Params().Zerocoin_Params(), coin.getDenomination());
+    AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, coin);
+    std::string strError;
+    BOOST_REQUIRE(GenerateAccumulatorWitness(coin, accumulator, witness, 100, nMintsAdded, strError));
+    BOOST_CHECK(witness.VerifyWitness(accumulator, coin));
+    bnWitness = witness.getValue();
+}
+
+//the index of a chain past the zerocoin start, with the mint of rawTxpub1 in a block on disk and in the tx index
+struct ZerocoinWitnessSetup {
+    CZerocoinDB* zerocoinDBSaved;
+    bool fTxIndexSaved;
+    PublicCoin coin;
+    CBlock blockCoin;
+    std::vector<CBlockIndex*> vIndexAdded;
+
+    ZerocoinWitnessSetup() : coin(Params().Zerocoin_Params(), CBigNum(rawTxpub1), ZQ_ONE)
+    {
+        LOCK(cs_main);
+        zerocoinDBSaved = zerocoinDB;
+        zerocoinDB = new CZerocoinDB(0, true);
+        fTxIndexSaved = fTxIndex;
+        fTxIndex = true;
+
+        CMutableTransaction txMint;
+        txMint.vout.resize(1);
+        txMint.vout[0].nValue = ZQ_ONE * COIN;
+        txMint.vout[0].scriptPubKey = CScript() << OP_ZEROCOINMINT << coin.getValue().getvch().size() << coin.getValue().getvch();
+        blockCoin.vtx.push_back(txMint);
+        blockCoin.hashMerkleRoot = blockCoin.BuildMerkleTree();
+        CDiskBlockPos pos(97, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(blockCoin, pos));
+        std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+        vPos.push_back(std::make_pair(blockCoin.vtx[0].GetHash(), CDiskTxPos(pos, GetSizeOfCompactSize(blockCoin.vtx.size()))));
+        BOOST_REQUIRE(pblocktree->WriteTxIndex(vPos));
+        BOOST_REQUIRE(zerocoinDB->WriteCoinMint(coin, blockCoin.vtx[0].GetHash()));
+
+        ExtendMintChain(chainActive.Genesis(), 0, blockCoin, coin.getValue(), vIndexAdded);
+    }
+
+    ~ZerocoinWitnessSetup()
+    {
+        CWalletDB(pwalletMain->strWalletFile).EraseZerocoinWitness(coin.getValue());
+
+        LOCK(cs_main);
+        chainActive.SetTip(chainActive.Genesis());
+        BOOST_FOREACH (CBlockIndex* pindex, vIndexAdded) {
+            mapBlockIndex.erase(pindex->GetBlockHash());
+            delete pindex;
+        }
+        delete zerocoinDB;
+        zerocoinDB = zerocoinDBSaved;
+        fTxIndex = fTxIndexSaved;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(zerocoin_witness_tests, ZerocoinWitnessSetup)
+
+BOOST_AUTO_TEST_CASE(witness_serialization)
+{
+    BOOST_CHECK(CZerocoinWitness().IsNull());
+
+    CZerocoinWitness witness;
+    witness.bnPubcoin = coin.getValue();
+    witness.nHeightMintAdded = COIN_MINT_HEIGHT;
+    witness.nAccStartHeight = COIN_ACC_START_HEIGHT;
+    witness.nHeight = COIN_ACC_START_HEIGHT + 35;
+    witness.hashBlock = uint256(7);
+    witness.bnWitness = CBigNum(rawTxRand1);
+    witness.nMintsAdded = 4;
+    witness.nCheckpointsAdded = 3;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << witness;
+    CZerocoinWitness witnessRead;
+    ss >> witnessRead;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(witnessRead.bnPubcoin == witness.bnPubcoin);
+    BOOST_CHECK_EQUAL(witnessRead.nHeightMintAdded, witness.nHeightMintAdded);
+    BOOST_CHECK_EQUAL(witnessRead.nAccStartHeight, witness.nAccStartHeight);
+    BOOST_CHECK_EQUAL(witnessRead.nHeight, witness.nHeight);
+    BOOST_CHECK(witnessRead.hashBlock == witness.hashBlock);
+    BOOST_CHECK(witnessRead.bnWitness == witness.bnWitness);
+    BOOST_CHECK_EQUAL(witnessRead.nMintsAdded, witness.nMintsAdded);
+    BOOST_CHECK_EQUAL(witnessRead.nCheckpointsAdded, witness.nCheckpointsAdded);
+
+    //kept in the wallet by pubcoin, overwritten as it advances
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    BOOST_CHECK(!walletdb.ReadZerocoinWitness(witness.bnPubcoin, witnessRead));
+    BOOST_CHECK(walletdb.WriteZerocoinWitness(witness));
+    witness.nHeight += 10;
+    BOOST_CHECK(walletdb.WriteZerocoinWitness(witness));
+    witnessRead.SetNull();
+    BOOST_CHECK(walletdb.ReadZerocoinWitness(witness.bnPubcoin, witnessRead));
+    BOOST_CHECK_EQUAL(witnessRead.nHeight, witness.nHeight);
+    BOOST_CHECK(witnessRead.bnWitness == witness.bnWitness);
+    BOOST_CHECK(witnessRead.hashBlock == witness.hashBlock);
+
+    BOOST_CHECK(walletdb.EraseZerocoinWitness(witness.bnPubcoin));
+    BOOST_CHECK(!walletdb.ReadZerocoinWitness(witness.bnPubcoin, witnessRead));
+}
+
+BOOST_AUTO_TEST_CASE(witness_advanced_by_checkpoint)
+{
+    LOCK(cs_main);
+    CBigNum bnWitness;
+    int nMintsAdded = 0;
+    GenerateFullWitness(coin, bnWitness, nMintsAdded);
+
+    //one checkpoint at a time, each in several updates that run out of blocks, resumed from the wallet every time
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CZerocoinWitness state;
+    for (int nHeightStop = COIN_ACC_START_HEIGHT + 10; nHeightStop <= WITNESS_STOP_HEIGHT; nHeightStop += 10) {
+        do {
+            int nBlocksLeft = 7;
+            BOOST_REQUIRE(AdvanceAccumulatorWitness(coin, state, nHeightStop, nBlocksLeft));
+            BOOST_REQUIRE(walletdb.WriteZerocoinWitness(state));
+            state.SetNull();
+            BOOST_REQUIRE(walletdb.ReadZerocoinWitness(coin.getValue(), state));
+        } while (state.nHeight < nHeightStop - 1);
+        BOOST_CHECK_EQUAL(state.nHeight, nHeightStop - 1);
+        BOOST_CHECK(state.hashBlock == chainActive[nHeightStop - 1]->GetBlockHash());
+    }
+    BOOST_CHECK_EQUAL(state.nHeightMintAdded, COIN_MINT_HEIGHT);
+    BOOST_CHECK_EQUAL(state.nAccStartHeight, COIN_ACC_START_HEIGHT);
+    BOOST_CHECK(state.bnWitness == bnWitness);
+
+    //a spend resuming from it adds nothing more and gets the same witness
+    Accumulator accumulator(Params().Zerocoin_Params(), ZQ_ONE);
+    AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, coin);
+    int nMintsResumed = 0;
+    std::string strError;
+    BOOST_CHECK(GenerateAccumulatorWitness(coin, accumulator, witness, 100, nMintsResumed, strError, &state));
+    BOOST_CHECK(witness.getValue() == bnWitness);
+    BOOST_CHECK_EQUAL(nMintsResumed, nMintsAdded);
+    BOOST_CHECK(witness.VerifyWitness(accumulator, coin));
+    BOOST_CHECK_EQUAL(state.nHeight, WITNESS_STOP_HEIGHT - 1);
+}
+
+BOOST_AUTO_TEST_CASE(witness_wallet_update)
+{
+    CBigNum bnWitness;
+    int nMintsAdded = 0;
+    {
+        LOCK(cs_main);
+        GenerateFullWitness(coin, bnWitness, nMintsAdded);
+    }
+
+    CZerocoinMint mint(ZQ_ONE, coin.getValue(), CBigNum(rawTxRand1), CBigNum(rawTxSerial1), false);
+    BOOST_REQUIRE(pwalletMain->WriteZerocoinMint(mint));
+    pwalletMain->nZerocoinWitnessHeight = 0;
+
+    //an update adds no more than MAX_ZEROCOIN_WITNESS_BLOCKS blocks, and the next one carries on from there
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    CZerocoinWitness state;
+    pwalletMain->UpdateZerocoinWitnesses();
+    BOOST_CHECK(walletdb.ReadZerocoinWitness(coin.getValue(), state));
+    BOOST_CHECK_EQUAL(state.nHeight, COIN_ACC_START_HEIGHT + MAX_ZEROCOIN_WITNESS_BLOCKS - 1);
+    BOOST_CHECK(pwalletMain->nZerocoinWitnessHeight < WITNESS_STOP_HEIGHT);
+
+    pwalletMain->UpdateZerocoinWitnesses();
+    BOOST_CHECK(walletdb.ReadZerocoinWitness(coin.getValue(), state));
+    BOOST_CHECK_EQUAL(state.nHeight, WITNESS_STOP_HEIGHT - 1);
+    BOOST_CHECK_EQUAL(pwalletMain->nZerocoinWitnessHeight, WITNESS_STOP_HEIGHT);
+    BOOST_CHECK(state.bnWitness == bnWitness);
+
+    BOOST_CHECK(pwalletMain->EraseZerocoinMint(mint));
+    pwalletMain->nZerocoinWitnessHeight = 0;
+}
+
+BOOST_AUTO_TEST_CASE(witness_after_reorg)
+{
+    LOCK(cs_main);
+    CZerocoinWitness state;
+    int nBlocksLeft = CHAIN_HEIGHT;
+    BOOST_REQUIRE(AdvanceAccumulatorWitness(coin, state, 2300, nBlocksLeft));
+    BOOST_REQUIRE_EQUAL(state.nHeight, 2299);
+    const CZerocoinWitness stateStale = state;
+
+    //the blocks from 2001 on are replaced by others with different mints
+    ExtendMintChain(chainActive[2000], 1, blockCoin, coin.getValue(), vIndexAdded);
+    BOOST_REQUIRE(chainActive[stateStale.nHeight]->GetBlockHash() != stateStale.hashBlock);
+    CBigNum bnWitness;
+    int nMintsAdded = 0;
+    GenerateFullWitness(coin, bnWitness, nMintsAdded);
+
+    //a spend given the stale witness builds it again from the start
+    Accumulator accumulator(Params().Zerocoin_Params(), ZQ_ONE);
+    AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, coin);
+    int nMintsSpend = 0;
+    std::string strError;
+    BOOST_CHECK(GenerateAccumulatorWitness(coin, accumulator, witness, 100, nMintsSpend, strError, &state));
+    BOOST_CHECK(witness.getValue() == bnWitness);
+    BOOST_CHECK_EQUAL(nMintsSpend, nMintsAdded);
+    BOOST_CHECK(witness.VerifyWitness(accumulator, coin));
+    BOOST_CHECK_EQUAL(state.nHeight, WITNESS_STOP_HEIGHT - 1);
+    BOOST_CHECK(state.hashBlock == chainActive[state.nHeight]->GetBlockHash());
+
+    //and so does the next update
+    state = stateStale;
+    nBlocksLeft = CHAIN_HEIGHT;
+    BOOST_CHECK(AdvanceAccumulatorWitness(coin, state, WITNESS_STOP_HEIGHT, nBlocksLeft));
+    BOOST_CHECK_EQUAL(state.nHeight, WITNESS_STOP_HEIGHT - 1);
+    BOOST_CHECK(state.hashBlock == chainActive[state.nHeight]->GetBlockHash());
+    BOOST_CHECK(state.bnWitness == bnWitness);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,6 +14,9 @@
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -209,82 +212,218 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
-{
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
-
+/** A block index record read from disk, waiting to be linked into mapBlockIndex */
+struct CBlockIndexLoadEntry {
+    uint256 hash;
+    uint256 hashPrev;
+    uint256 hashNext;
+    CBlockIndex* pindex;
+};
+
+/** The slice of the block index that one loader thread reads, by the first byte of the block hash in the key */
+struct CBlockIndexLoadRange {
+    int nBegin;
+    int nEnd;
+    boost::scoped_ptr<leveldb::Iterator> pcursor;
+    std::vector<CBlockIndexLoadEntry> vEntries;
+    std::vector<size_t> vUnlinked;
+    std::string strError;
+};
+
+static void LoadBlockIndexRange(CBlockIndexLoadRange& range)
+{
+    uint256 hashBegin = 0;
+    *hashBegin.begin() = range.nBegin;
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair('b', uint256(0));
-    pcursor->Seek(ssKeySet.str());
+    ssKeySet << make_pair('b', hashBegin);
+    range.pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
+    try {
+        while (range.pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            leveldb::Slice slKey = range.pcursor->key();
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
+            uint256 hashKey;
             ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+            if (chType != 'b')
+                break;
+            ssKey >> hashKey;
+            if (*hashKey.begin() >= range.nEnd)
+                break;
+
+            leveldb::Slice slValue = range.pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = new CBlockIndex();
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            pindexNew->SetZerocoinSupply(diskindex);
+            pindexNew->SetMints(diskindex);
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            CBlockIndexLoadEntry entry;
+            entry.hash = diskindex.GetBlockHash();
+            entry.hashPrev = diskindex.hashPrev;
+            entry.hashNext = diskindex.hashNext;
+            entry.pindex = pindexNew;
+            range.vEntries.push_back(entry);
+
+            if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
+                if (!CheckProofOfWork(entry.hash, pindexNew->nBits)) {
+                    range.strError = strprintf("CheckProofOfWork failed: %s", pindexNew->ToString());
+                    return;
                 }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+            }
 
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any invalid checkpoints
-                    if (!InvalidCheckpointRange(pindexNew->nHeight))
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+            range.pcursor->Next();
+        }
+    } catch (boost::thread_interrupted&) {
+        throw;
+    } catch (std::exception& e) {
+        range.strError = strprintf("Deserialize or I/O error - %s", e.what());
+    }
+}
 
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
+static CBlockIndex* FindLoadedBlockIndex(const uint256& hash, bool& fMissing)
+{
+    if (hash == 0)
+        return NULL;
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end()) {
+        fMissing = true;
+        return NULL;
+    }
+    return mi->second;
+}
+
+/** Only reads mapBlockIndex, so the ranges can be linked concurrently */
+static void LinkBlockIndexRange(CBlockIndexLoadRange& range)
+{
+    for (size_t i = 0; i < range.vEntries.size(); i++) {
+        const CBlockIndexLoadEntry& entry = range.vEntries[i];
+        bool fMissing = false;
+        entry.pindex->pprev = FindLoadedBlockIndex(entry.hashPrev, fMissing);
+        entry.pindex->pnext = FindLoadedBlockIndex(entry.hashNext, fMissing);
+        if (fMissing)
+            range.vUnlinked.push_back(i);
+    }
+}
+
+static void RunBlockIndexLoadThreads(boost::ptr_vector<CBlockIndexLoadRange>& vRanges, void (*fn)(CBlockIndexLoadRange&))
+{
+    if (vRanges.size() == 1) {
+        fn(vRanges[0]);
+        return;
+    }
+
+    boost::thread_group threadGroup;
+    for (size_t i = 0; i < vRanges.size(); i++)
+        threadGroup.create_thread(boost::bind(fn, boost::ref(vRanges[i])));
+    try {
+        threadGroup.join_all();
+    } catch (boost::thread_interrupted&) {
+        // the ranges belong to our caller, don't leave threads behind that still use them
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        throw;
+    }
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(int nThreads)
+{
+    // Read and deserialize the index in parallel, one key range per thread
+    nThreads = std::max(1, std::min(nThreads, 256));
+    boost::ptr_vector<CBlockIndexLoadRange> vRanges;
+    for (int i = 0; i < nThreads; i++) {
+        CBlockIndexLoadRange* prange = new CBlockIndexLoadRange();
+        prange->nBegin = i * 256 / nThreads;
+        prange->nEnd = (i + 1) * 256 / nThreads;
+        prange->pcursor.reset(NewIterator());
+        vRanges.push_back(prange);
+    }
+    RunBlockIndexLoadThreads(vRanges, LoadBlockIndexRange);
+
+    bool fError = false;
+    BOOST_FOREACH (const CBlockIndexLoadRange& range, vRanges) {
+        if (!range.strError.empty()) {
+            error("LoadBlockIndex() : %s", range.strError);
+            fError = true;
+        }
+    }
+    if (fError) {
+        BOOST_FOREACH (CBlockIndexLoadRange& range, vRanges) {
+            BOOST_FOREACH (CBlockIndexLoadEntry& entry, range.vEntries)
+                delete entry.pindex;
+        }
+        return false;
+    }
 
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+    // Load mapBlockIndex, in key order as before
+    size_t nEntries = mapBlockIndex.size();
+    BOOST_FOREACH (const CBlockIndexLoadRange& range, vRanges)
+        nEntries += range.vEntries.size();
+    mapBlockIndex.reserve(nEntries);
+    uint256 nPreviousCheckpoint;
+    BOOST_FOREACH (CBlockIndexLoadRange& range, vRanges) {
+        boost::this_thread::interruption_point();
+        BOOST_FOREACH (CBlockIndexLoadEntry& entry, range.vEntries) {
+            pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(make_pair(entry.hash, entry.pindex));
+            if (!ret.second) {
+                // an entry made for a block referenced before it was loaded
+                CBlockIndex* pindexExisting = ret.first->second;
+                *pindexExisting = *entry.pindex;
+                delete entry.pindex;
+                entry.pindex = pindexExisting;
+            }
+            CBlockIndex* pindexNew = entry.pindex;
+            pindexNew->phashBlock = &ret.first->first;
+
+            // ppcoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+            //populate accumulator checksum map in memory
+            if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+                //Don't load any invalid checkpoints
+                if (!InvalidCheckpointRange(pindexNew->nHeight))
+                    LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+
+                nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    // Link the entries to their neighbours in parallel, then add the few that point outside the index
+    RunBlockIndexLoadThreads(vRanges, LinkBlockIndexRange);
+    BOOST_FOREACH (CBlockIndexLoadRange& range, vRanges) {
+        BOOST_FOREACH (size_t i, range.vUnlinked) {
+            const CBlockIndexLoadEntry& entry = range.vEntries[i];
+            entry.pindex->pprev = InsertBlockIndex(entry.hashPrev);
+            entry.pindex->pnext = InsertBlockIndex(entry.hashNext);
         }
     }
 
@@ -366,3 +505,36 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('a', nChecksum));
 }
+
+//The mints of each denomination in a block, keyed by (denomination, height)
+bool CZerocoinDB::WriteBlockMints(int nHeight, const uint256& hashBlock, const std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> >& mapMints)
+{
+    CLevelDBBatch batch;
+    for (auto& denom : zerocoinDenomList) {
+        std::map<CoinDenomination, std::vector<CZerocoinMintIndexEntry> >::const_iterator it = mapMints.find(denom);
+        if (it == mapMints.end())
+            batch.Erase(make_pair('h', make_pair((int)denom, nHeight)));
+        else
+            batch.Write(make_pair('h', make_pair((int)denom, nHeight)), make_pair(hashBlock, it->second));
+    }
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::ReadBlockMints(CoinDenomination denom, int nHeight, uint256& hashBlock, std::vector<CZerocoinMintIndexEntry>& vMints)
+{
+    std::pair<uint256, std::vector<CZerocoinMintIndexEntry> > value;
+    if (!Read(make_pair('h', make_pair((int)denom, nHeight)), value))
+        return false;
+
+    hashBlock = value.first;
+    vMints.swap(value.second);
+    return true;
+}
+
+bool CZerocoinDB::EraseBlockMints(int nHeight)
+{
+    CLevelDBBatch batch;
+    for (auto& denom : zerocoinDenomList)
+        batch.Erase(make_pair('h', make_pair((int)denom, nHeight)));
+    return WriteBatch(batch);
+}
@@ -67,7 +67,31 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
-    bool LoadBlockIndexGuts();
+    //! Fill mapBlockIndex from the stored index, reading and deserializing it with nThreads threads
+    bool LoadBlockIndexGuts(int nThreads = 1);
+};
+
+/** A mint in the zerocoin mint index, with the outpoints that decide whether it is filtered as invalid */
+class CZerocoinMintIndexEntry
+{
+public:
+    CBigNum bnValue;
+    uint256 hashTx;
+    uint32_t nOut;
+    std::vector<COutPoint> vPrevouts;
+
+    CZerocoinMintIndexEntry() : nOut(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(bnValue);
+        READWRITE(hashTx);
+        READWRITE(nOut);
+        READWRITE(vPrevouts);
+    }
 };
 
 class CZerocoinDB : public CLevelDBWrapper
@@ -89,6 +113,9 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    bool WriteBlockMints(int nHeight, const uint256& hashBlock, const std::map<libzerocoin::CoinDenomination, std::vector<CZerocoinMintIndexEntry> >& mapMints);
+    bool ReadBlockMints(libzerocoin::CoinDenomination denom, int nHeight, uint256& hashBlock, std::vector<CZerocoinMintIndexEntry>& vMints);
+    bool EraseBlockMints(int nHeight);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -18,16 +18,24 @@
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nFeeDelta(0),
+                                     nCountWithAncestors(1), nSizeWithAncestors(0), nModFeesWithAncestors(0),
+                                     nCountWithDescendants(1), nSizeWithDescendants(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -44,6 +52,27 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+bool CompareTxMemPoolEntryByAncestorScore::operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+{
+    // a package never scores above the fee rate of its last transaction, so a cheap child doesn't ride on its parent
+    double aFees = a->GetModFeesWithAncestors(), aSize = a->GetSizeWithAncestors();
+    if ((double)a->GetModifiedFee() * aSize < aFees * a->GetTxSize()) {
+        aFees = a->GetModifiedFee();
+        aSize = a->GetTxSize();
+    }
+    double bFees = b->GetModFeesWithAncestors(), bSize = b->GetSizeWithAncestors();
+    if ((double)b->GetModifiedFee() * bSize < bFees * b->GetTxSize()) {
+        bFees = b->GetModifiedFee();
+        bSize = b->GetTxSize();
+    }
+
+    double f1 = aFees * bSize;
+    double f2 = bFees * aSize;
+    if (f1 == f2)
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    return f1 > f2;
+}
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -410,18 +439,209 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
+        if (mapTx.count(hash))
+            return true;
+        CTxMemPoolEntry& newEntry = mapTx.insert(std::make_pair(hash, entry)).first->second;
+        const CTransaction& tx = newEntry.GetTx();
+        TxLinks& links = mapLinks[hash];
         if(!tx.IsZerocoinSpend()) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+                const uint256& hashPrev = tx.vin[i].prevout.hash;
+                if (mapTx.count(hashPrev)) {
+                    links.setParents.insert(hashPrev);
+                    mapLinks[hashPrev].setChildren.insert(hash);
+                }
+            }
         }
+        // a transaction back from a disconnected block can already have children here
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
+            if (it == mapNextTx.end())
+                continue;
+            const uint256& hashChild = it->second.ptx->GetHash();
+            links.setChildren.insert(hashChild);
+            mapLinks[hashChild].setParents.insert(hash);
+        }
+
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+        if (pos != mapDeltas.end())
+            newEntry.nFeeDelta = pos->second.second;
+        newEntry.nModFeesWithAncestors = newEntry.GetModifiedFee();
+
+        std::set<uint256> setAncestors;
+        CalculateMemPoolAncestors(hash, setAncestors);
+        if (links.setChildren.empty()) {
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+                newEntry.nCountWithAncestors++;
+                newEntry.nSizeWithAncestors += ancestor.GetTxSize();
+                newEntry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+                ancestor.nCountWithDescendants++;
+                ancestor.nSizeWithDescendants += newEntry.GetTxSize();
+            }
+            setAncestorScore.insert(&newEntry);
+        } else {
+            // this joins two parts of a chain, whose shared ancestors and descendants are simplest recounted;
+            // it only happens when a block is disconnected
+            setAncestorScore.insert(&newEntry);
+            CalculateDescendants(hash, setAncestors);
+            setAncestors.insert(hash);
+            BOOST_FOREACH (const uint256& hashRelated, setAncestors)
+                RecountState(hashRelated);
+        }
+
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
     }
     return true;
 }
 
+void CTxMemPool::CalculateMemPoolAncestors(const uint256& hash, std::set<uint256>& setAncestors) const
+{
+    AssertLockHeld(cs);
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        uint256 hashVisit = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH (const uint256& hashParent, GetMemPoolParents(hashVisit)) {
+            if (setAncestors.insert(hashParent).second)
+                vToVisit.push_back(hashParent);
+        }
+    }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTransaction& tx, std::set<uint256>& setAncestors, uint64_t nLimitAncestorCount, uint64_t nLimitAncestorSize, uint64_t nLimitDescendantCount, uint64_t nLimitDescendantSize, std::string& errString) const
+{
+    AssertLockHeld(cs);
+    uint64_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nSizeWithAncestors = nTxSize;
+    std::vector<uint256> vToVisit;
+    if (!tx.IsZerocoinSpend()) {
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            if (mapTx.count(txin.prevout.hash))
+                vToVisit.push_back(txin.prevout.hash);
+        }
+    }
+    while (!vToVisit.empty()) {
+        uint256 hashVisit = vToVisit.back();
+        vToVisit.pop_back();
+        if (!setAncestors.insert(hashVisit).second)
+            continue;
+        const CTxMemPoolEntry& ancestor = mapTx.find(hashVisit)->second;
+        nSizeWithAncestors += ancestor.GetTxSize();
+        if (setAncestors.size() + 1 > nLimitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", nLimitAncestorCount);
+            return false;
+        }
+        if (nSizeWithAncestors > nLimitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", nLimitAncestorSize);
+            return false;
+        }
+        if (ancestor.GetCountWithDescendants() + 1 > nLimitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", hashVisit.ToString(), nLimitDescendantCount);
+            return false;
+        }
+        if (ancestor.GetSizeWithDescendants() + nTxSize > nLimitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", hashVisit.ToString(), nLimitDescendantSize);
+            return false;
+        }
+        BOOST_FOREACH (const uint256& hashParent, GetMemPoolParents(hashVisit)) {
+            if (!setAncestors.count(hashParent))
+                vToVisit.push_back(hashParent);
+        }
+    }
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    AssertLockHeld(cs);
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        uint256 hashVisit = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH (const uint256& hashChild, GetMemPoolChildren(hashVisit)) {
+            if (setDescendants.insert(hashChild).second)
+                vToVisit.push_back(hashChild);
+        }
+    }
+}
+
+const std::set<uint256>& CTxMemPool::GetMemPoolParents(const uint256& hash) const
+{
+    AssertLockHeld(cs);
+    static const std::set<uint256> setEmpty;
+    std::map<uint256, TxLinks>::const_iterator it = mapLinks.find(hash);
+    return it == mapLinks.end() ? setEmpty : it->second.setParents;
+}
+
+const std::set<uint256>& CTxMemPool::GetMemPoolChildren(const uint256& hash) const
+{
+    AssertLockHeld(cs);
+    static const std::set<uint256> setEmpty;
+    std::map<uint256, TxLinks>::const_iterator it = mapLinks.find(hash);
+    return it == mapLinks.end() ? setEmpty : it->second.setChildren;
+}
+
+/** Adds to the ancestor statistics of an entry, moving it to its new place in setAncestorScore */
+void CTxMemPool::UpdateAncestorState(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees)
+{
+    setAncestorScore.erase(&entry);
+    entry.nCountWithAncestors += nCount;
+    entry.nSizeWithAncestors += nSize;
+    entry.nModFeesWithAncestors += nModFees;
+    setAncestorScore.insert(&entry);
+}
+
+/** Sets the fee delta of an entry, and passes the change on to the ancestor fees of its descendants */
+void CTxMemPool::UpdateModifiedFee(CTxMemPoolEntry& entry, CAmount nFeeDelta)
+{
+    CAmount nChange = nFeeDelta - entry.nFeeDelta;
+    setAncestorScore.erase(&entry);
+    entry.nFeeDelta = nFeeDelta;
+    entry.nModFeesWithAncestors += nChange;
+    setAncestorScore.insert(&entry);
+
+    std::set<uint256> setDescendants;
+    CalculateDescendants(entry.GetTx().GetHash(), setDescendants);
+    BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+        UpdateAncestorState(mapTx.find(hashDescendant)->second, 0, 0, nChange);
+}
+
+/** Recounts the ancestor and descendant statistics of one entry from the links */
+void CTxMemPool::RecountState(const uint256& hash)
+{
+    std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+    CTxMemPoolEntry& entry = it->second;
+    setAncestorScore.erase(&entry);
+
+    std::set<uint256> setAncestors;
+    CalculateMemPoolAncestors(hash, setAncestors);
+    entry.nCountWithAncestors = 1;
+    entry.nSizeWithAncestors = entry.GetTxSize();
+    entry.nModFeesWithAncestors = entry.GetModifiedFee();
+    BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+        const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+        entry.nCountWithAncestors++;
+        entry.nSizeWithAncestors += ancestor.GetTxSize();
+        entry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+    }
+
+    std::set<uint256> setDescendants;
+    CalculateDescendants(hash, setDescendants);
+    entry.nCountWithDescendants = 1;
+    entry.nSizeWithDescendants = entry.GetTxSize();
+    BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+        entry.nCountWithDescendants++;
+        entry.nSizeWithDescendants += mapTx.find(hashDescendant)->second.GetTxSize();
+    }
+
+    setAncestorScore.insert(&entry);
+}
+
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
@@ -442,28 +662,76 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 txToRemove.push_back(it->second.ptx->GetHash());
             }
         }
+        std::vector<uint256> vRemove;
+        std::set<uint256> setRemove;
         while (!txToRemove.empty()) {
             uint256 hash = txToRemove.front();
             txToRemove.pop_front();
-            if (!mapTx.count(hash))
+            if (!mapTx.count(hash) || !setRemove.insert(hash).second)
                 continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
+            vRemove.push_back(hash);
             if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                for (unsigned int i = 0; i < mapTx[hash].GetTx().vout.size(); i++) {
                     std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
                     if (it == mapNextTx.end())
                         continue;
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
             }
+        }
+
+        // Take each removed entry out of the statistics of the ancestors and descendants that stay,
+        // while the links still connect them
+        std::set<uint256> setRecount;
+        BOOST_FOREACH (const uint256& hash, vRemove) {
+            const CTxMemPoolEntry& entry = mapTx[hash];
+            std::set<uint256> setAncestors, setDescendants;
+            CalculateMemPoolAncestors(hash, setAncestors);
+            CalculateDescendants(hash, setDescendants);
+            std::vector<uint256> vKeptDescendants;
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+                if (!setRemove.count(hashDescendant))
+                    vKeptDescendants.push_back(hashDescendant);
+            }
+            if (!setAncestors.empty() && !vKeptDescendants.empty()) {
+                // a chain cut in the middle loses more than this entry on both sides
+                setRecount.insert(setAncestors.begin(), setAncestors.end());
+                setRecount.insert(vKeptDescendants.begin(), vKeptDescendants.end());
+                continue;
+            }
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (setRemove.count(hashAncestor))
+                    continue;
+                CTxMemPoolEntry& ancestor = mapTx[hashAncestor];
+                ancestor.nCountWithDescendants--;
+                ancestor.nSizeWithDescendants -= entry.GetTxSize();
+            }
+            BOOST_FOREACH (const uint256& hashDescendant, vKeptDescendants)
+                UpdateAncestorState(mapTx[hashDescendant], -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
+        }
+
+        BOOST_FOREACH (const uint256& hash, vRemove) {
+            const CTransaction& tx = mapTx[hash].GetTx();
             BOOST_FOREACH (const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
 
+            std::map<uint256, TxLinks>::iterator itLinks = mapLinks.find(hash);
+            if (itLinks != mapLinks.end()) {
+                BOOST_FOREACH (const uint256& hashParent, itLinks->second.setParents)
+                    mapLinks[hashParent].setChildren.erase(hash);
+                BOOST_FOREACH (const uint256& hashChild, itLinks->second.setChildren)
+                    mapLinks[hashChild].setParents.erase(hash);
+                mapLinks.erase(itLinks);
+            }
+            setAncestorScore.erase(&mapTx[hash]);
+
             removed.push_back(tx);
             totalTxSize -= mapTx[hash].GetTxSize();
             mapTx.erase(hash);
             nTransactionsUpdated++;
         }
+        BOOST_FOREACH (const uint256& hash, setRecount)
+            RecountState(hash);
     }
 }
 
@@ -533,6 +801,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    setAncestorScore.clear();
+    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -557,12 +827,14 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         checkTotal += it->second.GetTxSize();
         const CTransaction& tx = it->second.GetTx();
         bool fDependsWait = false;
+        std::set<uint256> setParentCheck;
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
             std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end()) {
                 const CTransaction& tx2 = it2->second.GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
+                setParentCheck.insert(txin.prevout.hash);
                 fDependsWait = true;
             } else {
                 const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
@@ -575,6 +847,31 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+
+        // Check the links and the ancestor and descendant statistics against a recount
+        assert(setParentCheck == GetMemPoolParents(it->first));
+        BOOST_FOREACH (const uint256& hashChild, GetMemPoolChildren(it->first))
+            assert(GetMemPoolParents(hashChild).count(it->first));
+        std::set<uint256> setAncestors;
+        CalculateMemPoolAncestors(it->first, setAncestors);
+        uint64_t nSizeCheck = it->second.GetTxSize();
+        CAmount nFeesCheck = it->second.GetModifiedFee();
+        BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+            nSizeCheck += mapTx.find(hashAncestor)->second.GetTxSize();
+            nFeesCheck += mapTx.find(hashAncestor)->second.GetModifiedFee();
+        }
+        assert(it->second.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->second.GetSizeWithAncestors() == nSizeCheck);
+        assert(it->second.GetModFeesWithAncestors() == nFeesCheck);
+        std::set<uint256> setDescendants;
+        CalculateDescendants(it->first, setDescendants);
+        nSizeCheck = it->second.GetTxSize();
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+            nSizeCheck += mapTx.find(hashDescendant)->second.GetTxSize();
+        assert(it->second.GetCountWithDescendants() == setDescendants.size() + 1);
+        assert(it->second.GetSizeWithDescendants() == nSizeCheck);
+        assert(setAncestorScore.count(&it->second));
+
         if (fDependsWait)
             waitingOnDependants.push_back(&it->second);
         else {
@@ -610,6 +907,8 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
 
+    assert(setAncestorScore.size() == mapTx.size());
+    assert(mapLinks.size() == mapTx.size());
     assert(totalTxSize == checkTotal);
 }
 
@@ -681,6 +980,9 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+        if (it != mapTx.end() && it->second.nFeeDelta != deltas.second)
+            UpdateModifiedFee(it->second, deltas.second);
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -700,6 +1002,9 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
 {
     LOCK(cs);
     mapDeltas.erase(hash);
+    std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+    if (it != mapTx.end() && it->second.nFeeDelta != 0)
+        UpdateModifiedFee(it->second, 0);
 }
 
 
@@ -9,6 +9,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -46,6 +47,17 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta;    //! Fee delta from PrioritiseTransaction
+
+    //! The transaction together with its in-mempool ancestors, kept up to date by CTxMemPool
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    //! ... and together with its in-mempool descendants
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+
+    friend class CTxMemPool;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -58,6 +70,23 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+};
+
+/**
+ * Orders mempool entries by the fee rate of the entry with its in-mempool ancestors,
+ * or its own fee rate if that is lower, highest first. Ties go by txid.
+ */
+class CompareTxMemPoolEntryByAncestorScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const;
 };
 
 class CMinerPolicyEstimator;
@@ -103,11 +132,24 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    struct TxLinks {
+        std::set<uint256> setParents;
+        std::set<uint256> setChildren;
+    };
+    std::map<uint256, TxLinks> mapLinks; //! in-mempool parents and children of each mapTx entry
+
+    void UpdateAncestorState(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees);
+    void UpdateModifiedFee(CTxMemPoolEntry& entry, CAmount nFeeDelta);
+    void RecountState(const uint256& hash);
+
 public:
+    typedef std::set<const CTxMemPoolEntry*, CompareTxMemPoolEntryByAncestorScore> ancestor_score_set;
+
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    ancestor_score_set setAncestorScore; //! the entries of mapTx in block assembly order
 
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
@@ -137,6 +179,20 @@ public:
     void ApplyDeltas(const uint256 hash, double& dPriorityDelta, CAmount& nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /** The in-mempool transactions that hash spends from, directly or not. Requires cs. */
+    void CalculateMemPoolAncestors(const uint256& hash, std::set<uint256>& setAncestors) const;
+    /**
+     * The in-mempool ancestors of tx, which is not in the pool yet. Fails with errString if
+     * tx would have too many or too large ancestors, or make any of them have too many or
+     * too large descendants (sizes in bytes). Requires cs.
+     */
+    bool CalculateMemPoolAncestors(const CTransaction& tx, std::set<uint256>& setAncestors, uint64_t nLimitAncestorCount, uint64_t nLimitAncestorSize, uint64_t nLimitDescendantCount, uint64_t nLimitDescendantSize, std::string& errString) const;
+    /** The in-mempool transactions that spend from hash, directly or not. Requires cs. */
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+    /** The in-mempool transactions hash spends from directly, and those that spend from it directly. Requires cs. */
+    const std::set<uint256>& GetMemPoolParents(const uint256& hash) const;
+    const std::set<uint256>& GetMemPoolChildren(const uint256& hash) const;
+
     unsigned long size()
     {
         LOCK(cs);
@@ -12,7 +12,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70918;
+static const int PROTOCOL_VERSION = 70919;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 211;
@@ -20,6 +20,9 @@ static const int INIT_PROTO_VERSION = 211;
 //! In this version, 'getheaders' was introduced.
 static const int GETHEADERS_VERSION = 70912;
 
+//! 'getheaders' is answered with 'headers' (not block invs) starting with this version
+static const int HEADERS_FIRST_VERSION = 70919;
+
 //! disconnect from peers older than this proto version
 static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT = 70915;
 static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 70916;
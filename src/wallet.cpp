@@ -113,6 +113,8 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
 
     // check if we need to remove from watch-only
     CScript script;
@@ -166,6 +168,8 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -190,6 +194,8 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -460,6 +466,60 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddToWalletUTXO(const CWalletTx& wtx) const
+{
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) != ISMINE_NO)
+            setWalletUTXO.insert(COutPoint(wtx.GetHash(), i));
+    }
+}
+
+bool CWallet::IsSpentBeyondReorg(const COutPoint& outpoint, int nMaxReorgDepth) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > nMaxReorgDepth)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * List the wallet transactions that have outputs in setWalletUTXO, with those outputs.
+ * Drops the outputs whose spend has got deeper than -maxreorg since the last call.
+ */
+void CWallet::GetWalletUTXO(std::vector<std::pair<const CWalletTx*, std::vector<unsigned int> > >& vTxOutputs) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fWalletUTXODirty) {
+        setWalletUTXO.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            AddToWalletUTXO(it->second);
+        fWalletUTXODirty = false;
+    }
+
+    int nMaxReorgDepth = GetArg("-maxreorg", Params().MaxReorganizationDepth());
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.end();
+    std::set<COutPoint>::iterator it = setWalletUTXO.begin();
+    while (it != setWalletUTXO.end()) {
+        if (mi == mapWallet.end() || mi->first != it->hash)
+            mi = mapWallet.find(it->hash);
+        if (mi == mapWallet.end() || IsSpentBeyondReorg(*it, nMaxReorgDepth)) {
+            setWalletUTXO.erase(it++);
+            continue;
+        }
+
+        if (vTxOutputs.empty() || vTxOutputs.back().first != &mi->second)
+            vTxOutputs.push_back(make_pair(&mi->second, std::vector<unsigned int>()));
+        vTxOutputs.back().second.push_back(it->n);
+        ++it;
+    }
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -631,6 +691,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        fBalancesDirty = true;
     }
 }
 
@@ -644,6 +705,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        fWalletUTXODirty = true; // keys may not all be loaded yet
+        fBalancesDirty = true;
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -685,6 +748,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
             if (!wtx.WriteToDisk())
                 return false;
 
+        if (!fWalletUTXODirty)
+            AddToWalletUTXO(wtx);
+        fBalancesDirty = true;
+
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
@@ -739,6 +806,16 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+void CWallet::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    //witnesses only ever reach two checkpoints below the tip, so there is nothing to add between checkpoints
+    int nHeightStop = pindex->nHeight - (pindex->nHeight % 10) - 20;
+    if (!fFileBacked || nHeightStop <= nZerocoinWitnessHeight || pindex->nHeight < Params().Zerocoin_StartHeight())
+        return;
+
+    UpdateZerocoinWitnesses();
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
@@ -747,6 +824,7 @@ void CWallet::EraseFromWallet(const uint256& hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        fBalancesDirty = true;
     }
     return;
 }
@@ -768,7 +846,8 @@ isminetype CWallet::IsMine(const CTxIn& txin) const
 
 bool CWallet::IsMyZerocoinSpend(const CBigNum& bnSerial) const
 {
-    return CWalletDB(strWalletFile).ReadZerocoinSpendSerialEntry(bnSerial);
+    LOCK(cs_wallet);
+    return setZerocoinSpendSerials.count(bnSerial) > 0;
 }
 
 CAmount CWallet::GetDebit(const CTxIn& txin, const isminefilter& filter) const
@@ -1553,19 +1632,78 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+const CWalletBalances& CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (!fBalancesDirty && pindexCachedBalances == chainActive.Tip() && nMempoolCachedBalances == mempool.GetTransactionsUpdated())
+        return cachedBalances;
+
+    cachedBalances.SetNull();
+    std::vector<std::pair<const CWalletTx*, std::vector<unsigned int> > > vTxOutputs;
+    GetWalletUTXO(vTxOutputs);
+    for (unsigned int j = 0; j < vTxOutputs.size(); j++) {
+        const CWalletTx* pcoin = vTxOutputs[j].first;
+        bool fTrusted = pcoin->IsTrusted();
+        int nDepth = pcoin->GetDepthInMainChain();
+
+        if (fTrusted) {
+            cachedBalances.nBalance += pcoin->GetAvailableCredit();
+            cachedBalances.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        if (!IsFinalTx(*pcoin) || (!fTrusted && nDepth == 0)) {
+            cachedBalances.nUnconfirmed += pcoin->GetAvailableCredit();
+            cachedBalances.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        cachedBalances.nImmature += pcoin->GetImmatureCredit();
+        cachedBalances.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit();
+        if (fTrusted && nDepth > 0) {
+            if (!fLiteMode) {
+                cachedBalances.nUnlocked += pcoin->GetUnlockedCredit();
+                cachedBalances.nLocked += pcoin->GetLockedCredit();
+            }
+            cachedBalances.nLockedWatchOnly += pcoin->GetLockedWatchOnlyCredit();
         }
     }
 
-    return nTotal;
+    pindexCachedBalances = chainActive.Tip();
+    nMempoolCachedBalances = mempool.GetTransactionsUpdated();
+    fBalancesDirty = false;
+    return cachedBalances;
+}
+
+bool CWallet::GetCachedZerocoinBalance(ZerocoinBalanceType type, CAmount& nAmount) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (pindexCachedZerocoinBalances != chainActive.Tip() || nMempoolCachedZerocoinBalances != mempool.GetTransactionsUpdated() || nZerocoinDBCachedBalances != nZerocoinDBUpdated)
+        mapCachedZerocoinBalances.clear();
+
+    std::map<int, CAmount>::const_iterator it = mapCachedZerocoinBalances.find(type);
+    if (it == mapCachedZerocoinBalances.end())
+        return false;
+    nAmount = it->second;
+    return true;
+}
+
+void CWallet::SetCachedZerocoinBalance(ZerocoinBalanceType type, CAmount nAmount) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    //counting may have written back mint heights and spent flags, which leaves the other balances behind
+    if (pindexCachedZerocoinBalances != chainActive.Tip() || nMempoolCachedZerocoinBalances != mempool.GetTransactionsUpdated() || nZerocoinDBCachedBalances != nZerocoinDBUpdated) {
+        mapCachedZerocoinBalances.clear();
+        pindexCachedZerocoinBalances = chainActive.Tip();
+        nMempoolCachedZerocoinBalances = mempool.GetTransactionsUpdated();
+        nZerocoinDBCachedBalances = nZerocoinDBUpdated;
+    }
+    mapCachedZerocoinBalances[type] = nAmount;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nBalance;
 }
 
 CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const
@@ -1577,10 +1715,14 @@ CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const
         myZerocoinSupply.insert(make_pair(denom, 0));
     }
 
+    LOCK2(cs_main, cs_wallet);
+    ZerocoinBalanceType type = fMatureOnly ? ZEROCOIN_BALANCE_MATURE : ZEROCOIN_BALANCE_ALL;
+    if (GetCachedZerocoinBalance(type, nTotal))
+        return nTotal;
+
     {
-        LOCK2(cs_main, cs_wallet);
         // Get Unused coins
-        list<CZerocoinMint> listPubCoin = CWalletDB(strWalletFile).ListMintedCoins(true, fMatureOnly, true);
+        list<CZerocoinMint> listPubCoin = ListMintedCoins(true, fMatureOnly, true);
         for (auto& mint : listPubCoin) {
             libzerocoin::CoinDenomination denom = mint.GetDenomination();
             nTotal += libzerocoin::ZerocoinDenominationToAmount(denom);
@@ -1594,6 +1736,7 @@ CAmount CWallet::GetZerocoinBalance(bool fMatureOnly) const
 
     if (nTotal < 0 ) nTotal = 0; // Sanity never hurts
 
+    SetCachedZerocoinBalance(type, nTotal);
     return nTotal;
 }
 
@@ -1605,8 +1748,11 @@ CAmount CWallet::GetImmatureZerocoinBalance() const
 CAmount CWallet::GetUnconfirmedZerocoinBalance() const
 {
     CAmount nUnconfirmed = 0;
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(true, false, true);
+    LOCK2(cs_main, cs_wallet);
+    if (GetCachedZerocoinBalance(ZEROCOIN_BALANCE_UNCONFIRMED, nUnconfirmed))
+        return nUnconfirmed;
+
+    list<CZerocoinMint> listMints = ListMintedCoins(true, false, true);
  
     std::map<libzerocoin::CoinDenomination, int> mapUnconfirmed;
     for (const auto& denom : libzerocoin::zerocoinDenomList){
@@ -1614,7 +1760,6 @@ CAmount CWallet::GetUnconfirmedZerocoinBalance() const
     }
 
     {
-        LOCK2(cs_main, cs_wallet);
         for (auto& mint : listMints){
             if (!mint.GetHeight() || mint.GetHeight() > chainActive.Height() - Params().Zerocoin_MintRequiredConfirmations()) {
                 libzerocoin::CoinDenomination denom = mint.GetDenomination();
@@ -1632,6 +1777,7 @@ CAmount CWallet::GetUnconfirmedZerocoinBalance() const
 
     if (nUnconfirmed < 0 ) nUnconfirmed = 0; // Sanity never hurts
 
+    SetCachedZerocoinBalance(ZEROCOIN_BALANCE_UNCONFIRMED, nUnconfirmed);
     return nUnconfirmed;
 }
 
@@ -1639,36 +1785,16 @@ CAmount CWallet::GetUnlockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnlocked;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nLocked;
 }
 
 // Get a Map pairing the Denominations with the amount of Zerocoin for each Denomination
@@ -1679,7 +1805,7 @@ std::map<libzerocoin::CoinDenomination, CAmount> CWallet::GetMyZerocoinDistribut
         spread.insert(std::pair<libzerocoin::CoinDenomination, CAmount>(denom, 0));
     {
         LOCK2(cs_main, cs_wallet);
-        list<CZerocoinMint> listPubCoin = CWalletDB(strWalletFile).ListMintedCoins(true, true, true);
+        list<CZerocoinMint> listPubCoin = ListMintedCoins(true, true, true);
         for (auto& mint : listPubCoin)
             spread.at(mint.GetDenomination())++;
     }
@@ -1805,85 +1931,38 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nImmatureWatchOnly;
 }
 
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nLockedWatchOnly;
 }
 
 /**
@@ -1895,9 +1974,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        std::vector<std::pair<const CWalletTx*, std::vector<unsigned int> > > vTxOutputs;
+        GetWalletUTXO(vTxOutputs);
+        for (unsigned int j = 0; j < vTxOutputs.size(); j++) {
+            const CWalletTx* pcoin = vTxOutputs[j].first;
+            const uint256& wtxid = pcoin->GetHash();
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1918,7 +1999,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            BOOST_FOREACH (unsigned int i, vTxOutputs[j].second) {
                 bool found = false;
                 if (nCoinType == ONLY_DENOMINATED) {
                     found = IsDenominatedAmount(pcoin->vout[i].nValue);
@@ -1948,11 +2029,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 if (mine == ISMINE_WATCH_ONLY)
                     continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_25000)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_25000)
                     continue;
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
                 bool fIsSpendable = false;
@@ -2861,6 +2942,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
+    //gather what the kernel hash of each coin depends on, then search them all at once
+    nTxNewTime = GetAdjustedTime();
+    std::vector<CStakeKernelInput> vKernelInputs;
+    std::vector<pair<const CWalletTx*, unsigned int> > vKernelCoins;
     BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
         //make sure that enough time has elapsed between
         CBlockIndex* pindex = NULL;
@@ -2876,72 +2961,66 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         // Read block header
         CBlockHeader block = pindex->GetBlockHeader();
 
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+        CStakeKernelInput input;
+        if (!GetStakeKernelInput(block, *pcoin.first, COutPoint(pcoin.first->GetHash(), pcoin.second), nTxNewTime, input, true))
+            continue;
+        vKernelInputs.push_back(input);
+        vKernelCoins.push_back(pcoin);
+    }
+
+    size_t nKernel = 0;
+    uint256 hashProofOfStake = 0;
+    if (!vKernelInputs.empty() && FindStakeKernel(vKernelInputs, nBits, nTxNewTime, nHashDrift, chainActive.Tip()->GetMedianTimePast(), nKernel, nTxNewTime, hashProofOfStake)) {
+        const pair<const CWalletTx*, unsigned int>& pcoin = vKernelCoins[nKernel];
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found\n");
 
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            return false;
+        }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            return false; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
+        //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+        const CBlockIndex* pIndex0 = chainActive.Tip();
+        uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
     }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -3658,6 +3737,7 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            fBalancesDirty = true; // an IX lock makes it trusted at depth 0
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
@@ -3669,18 +3749,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    fBalancesDirty = true;
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    fBalancesDirty = true;
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    fBalancesDirty = true;
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -4452,7 +4535,15 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
     libzerocoin::AccumulatorWitness witness(Params().Zerocoin_Params(), accumulator, pubCoinSelected);
     string strFailReason = "";
     int nMintsAdded = 0;
-    if (!GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason)) {
+    CZerocoinWitness witnessState;
+    if (!CWalletDB(strWalletFile).ReadZerocoinWitness(pubCoinSelected.getValue(), witnessState))
+        witnessState.SetNull();
+    uint256 hashWitnessBlock = witnessState.hashBlock;
+    bool fWitness = GenerateAccumulatorWitness(pubCoinSelected, accumulator, witness, nSecurityLevel, nMintsAdded, strFailReason, &witnessState);
+    if (witnessState.hashBlock != hashWitnessBlock && !CWalletDB(strWalletFile).WriteZerocoinWitness(witnessState))
+        LogPrintf("%s : failed to write zerocoin witness\n", __func__);
+
+    if (!fWitness) {
         receipt.SetStatus(_("Try to spend with a higher security level to include more coins"), ZWGR_FAILED_ACCUMULATOR_INITIALIZATION);
         LogPrintf("%s : %s \n", __func__, receipt.GetStatusMessage());
         return false;
@@ -4503,18 +4594,15 @@ bool CWallet::MintToTxIn(CZerocoinMint zerocoinSelected, int nSecurityLevel, con
             return false;
         }
 
-        std::list<CBigNum> listCoinSpendSerial = CWalletDB(strWalletFile).ListSpentCoinsSerial();
-        for (const CBigNum& item : listCoinSpendSerial) {
-            if (spend.getCoinSerialNumber() == item) {
-                //Tried to spend an already spent zWgr
-                zerocoinSelected.SetUsed(true);
-                if (!CWalletDB(strWalletFile).WriteZerocoinMint(zerocoinSelected))
-                    LogPrintf("%s failed to write zerocoinmint\n", __func__);
+        if (IsMyZerocoinSpend(spend.getCoinSerialNumber())) {
+            //Tried to spend an already spent zWgr
+            zerocoinSelected.SetUsed(true);
+            if (!WriteZerocoinMint(zerocoinSelected))
+                LogPrintf("%s failed to write zerocoinmint\n", __func__);
 
-                pwalletMain->NotifyZerocoinChanged(pwalletMain, zerocoinSelected.GetValue().GetHex(), "Used", CT_UPDATED);
-                receipt.SetStatus(_("The coin spend has been used"), ZWGR_SPENT_USED_ZWGR);
-                return false;
-            }
+            pwalletMain->NotifyZerocoinChanged(pwalletMain, zerocoinSelected.GetValue().GetHex(), "Used", CT_UPDATED);
+            receipt.SetStatus(_("The coin spend has been used"), ZWGR_SPENT_USED_ZWGR);
+            return false;
         }
 
         uint32_t nAccumulatorChecksum = GetChecksum(accumulator.getValue());
@@ -4550,14 +4638,13 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
     nStatus = ZWGR_TRX_CREATE;
 
     // If not already given pre-selected mints, then select mints from the wallet
-    CWalletDB walletdb(pwalletMain->strWalletFile);
     list<CZerocoinMint> listMints;
     CAmount nValueSelected = 0;
     int nCoinsReturned = 0; // Number of coins returned in change from function below (for debug)
     int nNeededSpends = 0;  // Number of spends which would be needed if selection failed
     const int nMaxSpends = Params().Zerocoin_MaxSpendsPerTransaction(); // Maximum possible spends for one zWGR transaction
     if (vSelectedMints.empty()) {
-        listMints = walletdb.ListMintedCoins(true, true, true); // need to find mints to spend
+        listMints = ListMintedCoins(true, true, true); // need to find mints to spend
         if(listMints.empty()) {
             receipt.SetStatus(_("Failed to find Zerocoins in in wallet.dat"), nStatus);
             return false;
@@ -4588,7 +4675,7 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
             receipt.SetStatus(_("Trying to spend an already spent serial #, try again."), nStatus);
 
             mint.SetUsed(true);
-            walletdb.WriteZerocoinMint(mint);
+            WriteZerocoinMint(mint);
 
             return false;
         }
@@ -4607,7 +4694,7 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
 
         // archive this mint as an orphan
         if (fArchive) {
-            walletdb.ArchiveMintOrphan(mint);
+            ArchiveMintOrphan(mint);
             nArchived++;
         }
     }
@@ -4715,7 +4802,7 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
             for (CZerocoinSpend spend : receipt.GetSpends()) {
                 spend.SetTxHash(txHash);
 
-                if (!CWalletDB(strWalletFile).WriteZerocoinSpendSerialEntry(spend)) {
+                if (!WriteZerocoinSpendSerialEntry(spend)) {
                     receipt.SetStatus(_("Failed to write coin serial number into wallet"), nStatus);
                 }
             }
@@ -4737,9 +4824,7 @@ string CWallet::ResetMintZerocoin(bool fExtendedSearch)
 {
     long updates = 0;
     long deletions = 0;
-    CWalletDB walletdb(pwalletMain->strWalletFile);
-
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, true);
+    list<CZerocoinMint> listMints = ListMintedCoins(false, false, true);
     vector<CZerocoinMint> vMintsToFind{ std::make_move_iterator(std::begin(listMints)), std::make_move_iterator(std::end(listMints)) };
     vector<CZerocoinMint> vMintsMissing;
     vector<CZerocoinMint> vMintsToUpdate;
@@ -4750,13 +4835,13 @@ string CWallet::ResetMintZerocoin(bool fExtendedSearch)
     // Update the meta data of mints that were marked for updating
     for (CZerocoinMint mint : vMintsToUpdate) {
         updates++;
-        walletdb.WriteZerocoinMint(mint);
+        WriteZerocoinMint(mint);
     }
 
     // Delete any mints that were unable to be located on the blockchain
     for (CZerocoinMint mint : vMintsMissing) {
         deletions++;
-        walletdb.ArchiveMintOrphan(mint);
+        ArchiveMintOrphan(mint);
     }
 
     NotifyzWGRReset();
@@ -4770,7 +4855,7 @@ string CWallet::ResetSpentZerocoin()
     long removed = 0;
     CWalletDB walletdb(pwalletMain->strWalletFile);
 
-    list<CZerocoinMint> listMints = walletdb.ListMintedCoins(false, false, false);
+    list<CZerocoinMint> listMints = ListMintedCoins(false, false, false);
     list<CZerocoinSpend> listSpends = walletdb.ListSpentCoins();
     list<CZerocoinSpend> listUnconfirmedSpends;
 
@@ -4793,8 +4878,8 @@ string CWallet::ResetSpentZerocoin()
                 removed++;
                 mint.SetUsed(false);
                 RemoveSerialFromDB(spend.GetSerial());
-                walletdb.WriteZerocoinMint(mint);
-                walletdb.EraseZerocoinSpendSerialEntry(spend.GetSerial());
+                WriteZerocoinMint(mint);
+                EraseZerocoinSpendSerialEntry(spend.GetSerial());
                 continue;
             }
         }
@@ -4836,7 +4921,7 @@ void CWallet::ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored)
         
         mint.SetTxHash(txHash);
         mint.SetHeight(mapBlockIndex.at(hashBlock)->nHeight);
-        if (!walletdb.UnarchiveZerocoin(mint)) {
+        if (!UnarchiveZerocoin(mint)) {
             LogPrintf("%s : failed to unarchive mint %s\n", __func__, mint.GetValue().GetHex());
         }
         listMintsRestored.emplace_back(mint);
@@ -4844,6 +4929,261 @@ void CWallet::ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored)
 }
 
 
+void CWallet::IndexZerocoinMint(const CZerocoinMint& mint) const
+{
+    std::map<CBigNum, CZerocoinMint>::iterator it = mapZerocoinMints.find(mint.GetValue());
+    if (it != mapZerocoinMints.end())
+        mapZerocoinMintSerials.erase(it->second.GetSerialNumber());
+    mapZerocoinMints[mint.GetValue()] = mint;
+    mapZerocoinMintSerials[mint.GetSerialNumber()] = mint.GetValue();
+}
+
+void CWallet::UnindexZerocoinMint(const CZerocoinMint& mint) const
+{
+    std::map<CBigNum, CZerocoinMint>::iterator it = mapZerocoinMints.find(mint.GetValue());
+    if (it == mapZerocoinMints.end())
+        return;
+    mapZerocoinMintSerials.erase(it->second.GetSerialNumber());
+    mapZerocoinMints.erase(it);
+}
+
+void CWallet::LoadZerocoinMint(const CZerocoinMint& mint)
+{
+    AssertLockHeld(cs_wallet);
+    IndexZerocoinMint(mint);
+}
+
+void CWallet::LoadZerocoinSpendSerial(const CBigNum& bnSerial)
+{
+    AssertLockHeld(cs_wallet);
+    setZerocoinSpendSerials.insert(bnSerial);
+}
+
+bool CWallet::WriteZerocoinMint(const CZerocoinMint& mint)
+{
+    LOCK(cs_wallet);
+    if (fFileBacked && !CWalletDB(strWalletFile).WriteZerocoinMint(mint))
+        return false;
+    IndexZerocoinMint(mint);
+    return true;
+}
+
+bool CWallet::ReadZerocoinMint(const CBigNum& bnPubcoin, CZerocoinMint& mint) const
+{
+    LOCK(cs_wallet);
+    std::map<CBigNum, CZerocoinMint>::const_iterator it = mapZerocoinMints.find(bnPubcoin);
+    if (it == mapZerocoinMints.end())
+        return false;
+    mint = it->second;
+    return true;
+}
+
+bool CWallet::EraseZerocoinMint(const CZerocoinMint& mint)
+{
+    LOCK(cs_wallet);
+    if (fFileBacked && !CWalletDB(strWalletFile).EraseZerocoinMint(mint))
+        return false;
+    UnindexZerocoinMint(mint);
+    return true;
+}
+
+bool CWallet::ArchiveMintOrphan(const CZerocoinMint& mint)
+{
+    LOCK(cs_wallet);
+    if (fFileBacked && !CWalletDB(strWalletFile).ArchiveMintOrphan(mint))
+        return false;
+    UnindexZerocoinMint(mint);
+    return true;
+}
+
+bool CWallet::UnarchiveZerocoin(const CZerocoinMint& mint)
+{
+    LOCK(cs_wallet);
+    if (fFileBacked && !CWalletDB(strWalletFile).UnarchiveZerocoin(mint))
+        return false;
+    IndexZerocoinMint(mint);
+    return true;
+}
+
+bool CWallet::WriteZerocoinSpendSerialEntry(const CZerocoinSpend& spend)
+{
+    LOCK(cs_wallet);
+    if (fFileBacked && !CWalletDB(strWalletFile).WriteZerocoinSpendSerialEntry(spend))
+        return false;
+    setZerocoinSpendSerials.insert(spend.GetSerial());
+    return true;
+}
+
+bool CWallet::EraseZerocoinSpendSerialEntry(const CBigNum& bnSerial)
+{
+    LOCK(cs_wallet);
+    if (fFileBacked && !CWalletDB(strWalletFile).EraseZerocoinSpendSerialEntry(bnSerial))
+        return false;
+    setZerocoinSpendSerials.erase(bnSerial);
+    return true;
+}
+
+std::list<CZerocoinMint> CWallet::ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus) const
+{
+    LOCK2(cs_main, cs_wallet);
+    std::list<CZerocoinMint> listPubCoin;
+    vector<CZerocoinMint> vOverWrite;
+    vector<CZerocoinMint> vArchive;
+    for (std::map<CBigNum, CZerocoinMint>::const_iterator it = mapZerocoinMints.begin(); it != mapZerocoinMints.end(); ++it) {
+        CZerocoinMint mint = it->second;
+
+        if (fUnusedOnly) {
+            if (mint.IsUsed())
+                continue;
+
+            //double check that we have no record of this serial being used
+            if (setZerocoinSpendSerials.count(mint.GetSerialNumber())) {
+                mint.SetUsed(true);
+                vOverWrite.emplace_back(mint);
+                continue;
+            }
+        }
+
+        if (fMaturedOnly || fUpdateStatus) {
+            //if there is not a record of the block height, then look it up and assign it
+            if (!mint.GetHeight()) {
+                CTransaction tx;
+                uint256 hashBlock;
+                if(!GetTransaction(mint.GetTxHash(), tx, hashBlock, true)) {
+                    LogPrintf("%s failed to find tx for mint txid=%s\n", __func__, mint.GetTxHash().GetHex());
+                    vArchive.emplace_back(mint);
+                    continue;
+                }
+
+                //if not in the block index, most likely is unconfirmed tx
+                if (mapBlockIndex.count(hashBlock)) {
+                    mint.SetHeight(mapBlockIndex[hashBlock]->nHeight);
+                    vOverWrite.emplace_back(mint);
+                } else if (fMaturedOnly){
+                    continue;
+                }
+            }
+
+            //not mature
+            if (mint.GetHeight() > chainActive.Height() - Params().Zerocoin_MintRequiredConfirmations()) {
+                if (!fMaturedOnly)
+                    listPubCoin.emplace_back(mint);
+                continue;
+            }
+
+            //if only requesting an update (fUpdateStatus) then skip the rest and add to list
+            if (fMaturedOnly) {
+                // check to make sure there are at least 3 other mints added to the accumulators after this
+                if (chainActive.Height() < mint.GetHeight() + 1)
+                    continue;
+
+                CBlockIndex *pindex = chainActive[mint.GetHeight() + 1];
+                int nMintsAdded = 0;
+                while(pindex->nHeight < chainActive.Height() - 30) { // 30 just to make sure that its at least 2 checkpoints from the top block
+                    nMintsAdded += pindex->GetMintCount(mint.GetDenomination());
+                    if(nMintsAdded >= Params().Zerocoin_RequiredAccumulation())
+                        break;
+                    pindex = chainActive[pindex->nHeight + 1];
+                }
+
+                if(nMintsAdded < Params().Zerocoin_RequiredAccumulation())
+                    continue;
+            }
+        }
+        listPubCoin.emplace_back(mint);
+    }
+
+    //overwrite any updates
+    for (const CZerocoinMint& mint : vOverWrite) {
+        if (fFileBacked && !CWalletDB(strWalletFile).WriteZerocoinMint(mint)) {
+            LogPrintf("%s failed to update mint from tx %s\n", __func__, mint.GetTxHash().GetHex());
+            continue;
+        }
+        IndexZerocoinMint(mint);
+    }
+
+    // archive mints
+    for (const CZerocoinMint& mint : vArchive) {
+        if (fFileBacked && !CWalletDB(strWalletFile).ArchiveMintOrphan(mint)) {
+            LogPrintf("%s failed to archive mint from %s\n", __func__, mint.GetTxHash().GetHex());
+            continue;
+        }
+        UnindexZerocoinMint(mint);
+    }
+
+    return listPubCoin;
+}
+
+bool CWallet::IsMyUnusedZerocoinSerial(const CBigNum& bnSerial) const
+{
+    LOCK(cs_wallet);
+    std::map<CBigNum, CBigNum>::const_iterator it = mapZerocoinMintSerials.find(bnSerial);
+    if (it == mapZerocoinMintSerials.end() || setZerocoinSpendSerials.count(bnSerial))
+        return false;
+    return !mapZerocoinMints[it->second].IsUsed();
+}
+
+void CWallet::UpdateZerocoinWitnesses()
+{
+    int nHeightStop;
+    {
+        LOCK(cs_main);
+        nHeightStop = chainActive.Height() - (chainActive.Height() % 10) - 20;
+    }
+
+    list<CZerocoinMint> listMints = ListMintedCoins(true, false, false);
+    std::map<CBigNum, CZerocoinWitness> mapWitnesses;
+    {
+        LOCK(cs_wallet);
+        CWalletDB walletdb(strWalletFile);
+        for (const CZerocoinMint& mint : listMints) {
+            if (!walletdb.ReadZerocoinWitness(mint.GetValue(), mapWitnesses[mint.GetValue()]))
+                mapWitnesses[mint.GetValue()].SetNull();
+        }
+    }
+
+    //catching up on old mints is spread over several updates so that connecting a block is never held up for long.
+    //Every witness is advanced one batch of blocks at a time, with cs_main held for that batch only, and the height
+    //they all reached is kept after each batch for the next update to resume from.
+    int nBlocksLeft = MAX_ZEROCOIN_WITNESS_BLOCKS;
+    while (nZerocoinWitnessHeight < nHeightStop) {
+        int nHeightBatch = std::min(nHeightStop, nZerocoinWitnessHeight + ZEROCOIN_WITNESS_BATCH_BLOCKS);
+        int nHeightReached = nHeightStop;
+        {
+            LOCK2(cs_main, cs_wallet);
+            CWalletDB walletdb(strWalletFile);
+            for (const CZerocoinMint& mint : listMints) {
+                //spent since it was listed
+                if (!mapZerocoinMints.count(mint.GetValue()) || mapZerocoinMints[mint.GetValue()].IsUsed())
+                    continue;
+
+                if (nBlocksLeft <= 0) {
+                    nHeightReached = nZerocoinWitnessHeight;
+                    break;
+                }
+
+                libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params(), mint.GetValue(), mint.GetDenomination());
+                CZerocoinWitness& witness = mapWitnesses[mint.GetValue()];
+                uint256 hashBlockPrev = witness.hashBlock;
+                if (!AdvanceAccumulatorWitness(pubcoin, witness, nHeightBatch, nBlocksLeft)) {
+                    LogPrint("zero", "%s : failed to advance witness for mint %s\n", __func__, mint.GetValue().GetHex());
+                    continue;
+                }
+
+                if (witness.hashBlock != hashBlockPrev && !walletdb.WriteZerocoinWitness(witness))
+                    LogPrintf("%s : failed to write witness for mint %s\n", __func__, mint.GetValue().GetHex());
+
+                nHeightReached = std::min(nHeightReached, witness.nHeight + 1);
+            }
+        }
+
+        //out of blocks for this update: the witnesses keep their progress and the next update resumes this batch
+        if (nHeightReached < nHeightBatch)
+            break;
+        nZerocoinWitnessHeight = nHeightReached;
+    }
+}
+
 void CWallet::ZWgrBackupWallet()
 {
     filesystem::path backupDir = GetDataDir() / "backups";
@@ -4941,10 +5281,9 @@ string CWallet::MintZerocoin(CAmount nValue, CWalletTx& wtxNew, vector<CZerocoin
         return _("Error: The transaction was rejected! This might happen if some of the coins in your wallet were already spent, such as if you used a copy of wallet.dat and coins were spent in the copy but not marked as spent here.");
     } else {
         //update mints with full transaction hash and then database them
-        CWalletDB walletdb(pwalletMain->strWalletFile);
         for (CZerocoinMint mint : vMints) {
             mint.SetTxHash(wtxNew.GetHash());
-            walletdb.WriteZerocoinMint(mint);
+            WriteZerocoinMint(mint);
             pwalletMain->NotifyZerocoinChanged(pwalletMain, mint.GetValue().GetHex(), "Used", CT_UPDATED);
         }
     }
@@ -4983,13 +5322,13 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
         //reset all mints
         for (CZerocoinMint mint : vMintsSelected) {
             mint.SetUsed(false); // having error, so set to false, to be able to use again
-            walletdb.WriteZerocoinMint(mint);
+            WriteZerocoinMint(mint);
             pwalletMain->NotifyZerocoinChanged(pwalletMain, mint.GetValue().GetHex(), "New", CT_UPDATED);
         }
 
         //erase spends
         for (CZerocoinSpend spend : receipt.GetSpends()) {
-            if (!walletdb.EraseZerocoinSpendSerialEntry(spend.GetSerial())) {
+            if (!EraseZerocoinSpendSerialEntry(spend.GetSerial())) {
                 receipt.SetStatus("Error: It cannot delete coin serial number in wallet", ZWGR_ERASE_SPENDS_FAILED);
             }
 
@@ -4999,7 +5338,7 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
 
         // erase new mints
         for (auto& mint : vNewMints) {
-            if (!walletdb.EraseZerocoinMint(mint)) {
+            if (!EraseZerocoinMint(mint)) {
                 receipt.SetStatus("Error: Unable to cannot delete zerocoin mint in wallet", ZWGR_ERASE_NEW_MINTS_FAILED);
             }
         }
@@ -5010,13 +5349,13 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
 
     for (CZerocoinMint mint : vMintsSelected) {
         mint.SetUsed(true);
-        if (!walletdb.WriteZerocoinMint(mint)) {
+        if (!WriteZerocoinMint(mint)) {
             receipt.SetStatus("Failed to write mint to db", nStatus);
             return false;
         }
 
         CZerocoinMint mintCheck;
-        if (!walletdb.ReadZerocoinMint(mint.GetValue(), mintCheck)) {
+        if (!ReadZerocoinMint(mint.GetValue(), mintCheck)) {
             receipt.SetStatus("failed to read mintcheck", nStatus);
             return false;
         }
@@ -5025,12 +5364,15 @@ bool CWallet::SpendZerocoin(CAmount nAmount, int nSecurityLevel, CWalletTx& wtxN
             receipt.SetStatus("Error, the mint did not get marked as used", nStatus);
             return false;
         }
+
+        //a spent mint has no further use for its witness
+        walletdb.EraseZerocoinWitness(mint.GetValue());
     }
 
     // write new Mints to db
     for (CZerocoinMint mint : vNewMints) {
         mint.SetTxHash(wtxNew.GetHash());
-        walletdb.WriteZerocoinMint(mint);
+        WriteZerocoinMint(mint);
     }
 
     receipt.SetStatus("Spend Successful", ZWGR_SPEND_OKAY);  // When we reach this point spending zWGR was successful
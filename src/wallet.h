@@ -26,6 +26,7 @@
 #include "walletdb.h"
 
 #include <algorithm>
+#include <list>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -59,6 +60,10 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
 static const int ZQ_6666 = 6666;
+//! Most blocks added to the wallet's zerocoin witnesses each time a new checkpoint is reached
+static const int MAX_ZEROCOIN_WITNESS_BLOCKS = 1000;
+//! Blocks every zerocoin witness is advanced by before the height they all reached is kept
+static const int ZEROCOIN_WITNESS_BATCH_BLOCKS = 100;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -116,6 +121,30 @@ struct CompactTallyItem {
     }
 };
 
+/** The transparent balances of a wallet, summed in one pass over its outputs */
+struct CWalletBalances {
+    CAmount nBalance;
+    CAmount nUnconfirmed;
+    CAmount nImmature;
+    CAmount nLocked;
+    CAmount nUnlocked;
+    CAmount nWatchOnly;
+    CAmount nUnconfirmedWatchOnly;
+    CAmount nImmatureWatchOnly;
+    CAmount nLockedWatchOnly;
+
+    CWalletBalances()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nBalance = nUnconfirmed = nImmature = nLocked = nUnlocked = 0;
+        nWatchOnly = nUnconfirmedWatchOnly = nImmatureWatchOnly = nLockedWatchOnly = 0;
+    }
+};
+
 /** A key pool entry */
 class CKeyPool
 {
@@ -187,6 +216,51 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /** Outputs of mapWallet that are ours, less those spent deeper than -maxreorg, which can never
+     * become spendable again. Coin selection, staking and the balances only look at the transactions
+     * these belong to. Rebuilt on first use after a key or script is added, as that can make outputs
+     * of transactions already in the wallet ours.
+     */
+    mutable std::set<COutPoint> setWalletUTXO;
+    mutable bool fWalletUTXODirty;
+    void AddToWalletUTXO(const CWalletTx& wtx) const;
+    bool IsSpentBeyondReorg(const COutPoint& outpoint, int nMaxReorgDepth) const;
+    void GetWalletUTXO(std::vector<std::pair<const CWalletTx*, std::vector<unsigned int> > >& vTxOutputs) const;
+
+    /** The balances of GetWalletUTXO as of the chain tip and mempool update count they were summed at.
+     * Transactions and keys coming in, erased or IX locked, and coins locked or unlocked change them
+     * without either of those moving, so they mark the sums dirty.
+     */
+    mutable CWalletBalances cachedBalances;
+    mutable const CBlockIndex* pindexCachedBalances;
+    mutable unsigned int nMempoolCachedBalances;
+    mutable bool fBalancesDirty;
+    const CWalletBalances& GetBalances() const;
+
+    //! zerocoin balances as of the chain tip, mempool update count and nZerocoinDBUpdated they were counted at
+    enum ZerocoinBalanceType {
+        ZEROCOIN_BALANCE_MATURE,
+        ZEROCOIN_BALANCE_ALL,
+        ZEROCOIN_BALANCE_UNCONFIRMED
+    };
+    mutable std::map<int, CAmount> mapCachedZerocoinBalances;
+    mutable const CBlockIndex* pindexCachedZerocoinBalances;
+    mutable unsigned int nMempoolCachedZerocoinBalances;
+    mutable unsigned int nZerocoinDBCachedBalances;
+    bool GetCachedZerocoinBalance(ZerocoinBalanceType type, CAmount& nAmount) const;
+    void SetCachedZerocoinBalance(ZerocoinBalanceType type, CAmount nAmount) const;
+
+    /** The zerocoin mints of the wallet database by pubcoin value, their serials, and the serials the
+     * wallet has spent. Loaded with the wallet and written through to the database by the zerocoin
+     * methods below, so listing mints and matching serials needs no database cursor. ListMintedCoins
+     * writes back mint heights and spent flags also for the const balance getters, hence mutable.
+     */
+    mutable std::map<CBigNum, CZerocoinMint> mapZerocoinMints;
+    mutable std::map<CBigNum, CBigNum> mapZerocoinMintSerials;
+    std::set<CBigNum> setZerocoinSpendSerials;
+    void IndexZerocoinMint(const CZerocoinMint& mint) const;
+    void UnindexZerocoinMint(const CZerocoinMint& mint) const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -209,8 +283,21 @@ public:
     std::string ResetMintZerocoin(bool fExtendedSearch);
     std::string ResetSpentZerocoin();
     void ReconsiderZerocoins(std::list<CZerocoinMint>& listMintsRestored);
+    void UpdateZerocoinWitnesses();
     void ZWgrBackupWallet();
 
+    void LoadZerocoinMint(const CZerocoinMint& mint);
+    void LoadZerocoinSpendSerial(const CBigNum& bnSerial);
+    bool WriteZerocoinMint(const CZerocoinMint& mint);
+    bool ReadZerocoinMint(const CBigNum& bnPubcoin, CZerocoinMint& mint) const;
+    bool EraseZerocoinMint(const CZerocoinMint& mint);
+    bool ArchiveMintOrphan(const CZerocoinMint& mint);
+    bool UnarchiveZerocoin(const CZerocoinMint& mint);
+    bool WriteZerocoinSpendSerialEntry(const CZerocoinSpend& spend);
+    bool EraseZerocoinSpendSerialEntry(const CBigNum& bnSerial);
+    std::list<CZerocoinMint> ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus) const;
+    bool IsMyUnusedZerocoinSerial(const CBigNum& bnSerial) const;
+
     /** Zerocin entry changed.
     * @note called with lock cs_wallet held.
     */
@@ -228,6 +315,7 @@ public:
     bool fWalletUnlockAnonymizeOnly;
     std::string strWalletFile;
     bool fBackupMints;
+    int nZerocoinWitnessHeight; //! witness stop height the zerocoin witnesses were last advanced to
 
     std::set<int64_t> setKeyPool;
     std::map<CKeyID, CKeyMetadata> mapKeyMetadata;
@@ -286,6 +374,14 @@ public:
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
+        nZerocoinWitnessHeight = 0;
+        fWalletUTXODirty = true;
+        pindexCachedBalances = NULL;
+        nMempoolCachedBalances = 0;
+        fBalancesDirty = true;
+        pindexCachedZerocoinBalances = NULL;
+        nMempoolCachedZerocoinBalances = 0;
+        nZerocoinDBCachedBalances = 0;
 
         // Stake Settings
         nHashDrift = 45;
@@ -441,6 +537,7 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void UpdatedBlockTip(const CBlockIndex* pindex);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
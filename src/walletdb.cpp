@@ -26,6 +26,7 @@ using namespace boost;
 using namespace std;
 
 static uint64_t nAccountingEntryNumber = 0;
+std::atomic<unsigned int> nZerocoinDBUpdated(0);
 
 //
 // CWalletDB
@@ -658,6 +659,14 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 strErr = "Error reading wallet database: LoadDestData failed";
                 return false;
             }
+        } else if (strType == "zerocoin") {
+            CZerocoinMint mint;
+            ssValue >> mint;
+            pwallet->LoadZerocoinMint(mint);
+        } else if (strType == "zcserial") {
+            CBigNum bnSerial;
+            ssKey >> bnSerial;
+            pwallet->LoadZerocoinSpendSerial(bnSerial);
         }
     } catch (...) {
         return false;
@@ -1035,10 +1044,12 @@ bool CWalletDB::EraseDestData(const std::string& address, const std::string& key
 
 bool CWalletDB::WriteZerocoinSpendSerialEntry(const CZerocoinSpend& zerocoinSpend)
 {
+    nZerocoinDBUpdated++;
     return Write(make_pair(string("zcserial"), zerocoinSpend.GetSerial()), zerocoinSpend, true);
 }
 bool CWalletDB::EraseZerocoinSpendSerialEntry(const CBigNum& serialEntry)
 {
+    nZerocoinDBUpdated++;
     return Erase(make_pair(string("zcserial"), serialEntry));
 }
 
@@ -1050,6 +1061,7 @@ bool CWalletDB::ReadZerocoinSpendSerialEntry(const CBigNum& bnSerial)
 
 bool CWalletDB::WriteZerocoinMint(const CZerocoinMint& zerocoinMint)
 {
+    nZerocoinDBUpdated++;
     CDataStream ss(SER_GETHASH, 0);
     ss << zerocoinMint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());
@@ -1069,6 +1081,7 @@ bool CWalletDB::ReadZerocoinMint(const CBigNum &bnPubCoinValue, CZerocoinMint& z
 
 bool CWalletDB::EraseZerocoinMint(const CZerocoinMint& zerocoinMint)
 {
+    nZerocoinDBUpdated++;
     CDataStream ss(SER_GETHASH, 0);
     ss << zerocoinMint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());
@@ -1076,8 +1089,36 @@ bool CWalletDB::EraseZerocoinMint(const CZerocoinMint& zerocoinMint)
     return Erase(make_pair(string("zerocoin"), hash));
 }
 
+bool CWalletDB::WriteZerocoinWitness(const CZerocoinWitness& witness)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << witness.bnPubcoin;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    return Write(make_pair(string("zcwitness"), hash), witness, true);
+}
+
+bool CWalletDB::ReadZerocoinWitness(const CBigNum& bnPubCoinValue, CZerocoinWitness& witness)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubCoinValue;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    return Read(make_pair(string("zcwitness"), hash), witness);
+}
+
+bool CWalletDB::EraseZerocoinWitness(const CBigNum& bnPubCoinValue)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnPubCoinValue;
+    uint256 hash = Hash(ss.begin(), ss.end());
+
+    return Erase(make_pair(string("zcwitness"), hash));
+}
+
 bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint)
 {
+    nZerocoinDBUpdated++;
     CDataStream ss(SER_GETHASH, 0);
     ss << zerocoinMint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());;
@@ -1097,6 +1138,7 @@ bool CWalletDB::ArchiveMintOrphan(const CZerocoinMint& zerocoinMint)
 
 bool CWalletDB::UnarchiveZerocoin(const CZerocoinMint& mint)
 {
+    nZerocoinDBUpdated++;
     CDataStream ss(SER_GETHASH, 0);
     ss << mint.GetValue();
     uint256 hash = Hash(ss.begin(), ss.end());;
@@ -1109,134 +1151,6 @@ bool CWalletDB::UnarchiveZerocoin(const CZerocoinMint& mint)
     return WriteZerocoinMint(mint);
 }
 
-std::list<CZerocoinMint> CWalletDB::ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus)
-{
-    std::list<CZerocoinMint> listPubCoin;
-    Dbc* pcursor = GetCursor();
-    if (!pcursor)
-        throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
-    unsigned int fFlags = DB_SET_RANGE;
-    vector<CZerocoinMint> vOverWrite;
-    vector<CZerocoinMint> vArchive;
-    for (;;)
-    {
-        // Read next record
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        if (fFlags == DB_SET_RANGE)
-            ssKey << make_pair(string("zerocoin"), uint256(0));
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
-        fFlags = DB_NEXT;
-        if (ret == DB_NOTFOUND)
-            break;
-        else if (ret != 0)
-        {
-            pcursor->close();
-            throw runtime_error(std::string(__func__)+" : error scanning DB");
-        }
-
-        // Unserialize
-        string strType;
-        ssKey >> strType;
-        if (strType != "zerocoin")
-            break;
-
-        uint256 value;
-        ssKey >> value;
-
-        CZerocoinMint mint;
-        ssValue >> mint;
-
-        if (fUnusedOnly) {
-            if (mint.IsUsed())
-                continue;
-
-            //double check that we have no record of this serial being used
-            if (ReadZerocoinSpendSerialEntry(mint.GetSerialNumber())) {
-                mint.SetUsed(true);
-                vOverWrite.emplace_back(mint);
-                continue;
-            }
-        }
-
-        if (fMaturedOnly || fUpdateStatus) {
-            //if there is not a record of the block height, then look it up and assign it
-            if (!mint.GetHeight()) {
-                CTransaction tx;
-                uint256 hashBlock;
-                if(!GetTransaction(mint.GetTxHash(), tx, hashBlock, true)) {
-                    LogPrintf("%s failed to find tx for mint txid=%s\n", __func__, mint.GetTxHash().GetHex());
-                    vArchive.emplace_back(mint);
-                    continue;
-                }
-
-                //if not in the block index, most likely is unconfirmed tx
-                if (mapBlockIndex.count(hashBlock)) {
-                    mint.SetHeight(mapBlockIndex[hashBlock]->nHeight);
-                    vOverWrite.emplace_back(mint);
-                } else if (fMaturedOnly){
-                    continue;
-                }
-            }
-
-            //not mature
-            if (mint.GetHeight() > chainActive.Height() - Params().Zerocoin_MintRequiredConfirmations()) {
-                if (!fMaturedOnly)
-                    listPubCoin.emplace_back(mint);
-                continue;
-            }
-
-            //if only requesting an update (fUpdateStatus) then skip the rest and add to list
-            if (fMaturedOnly) {
-                // check to make sure there are at least 3 other mints added to the accumulators after this
-                if (chainActive.Height() < mint.GetHeight() + 1)
-                    continue;
-
-                CBlockIndex *pindex = chainActive[mint.GetHeight() + 1];
-                int nMintsAdded = 0;
-                while(pindex->nHeight < chainActive.Height() - 30) { // 30 just to make sure that its at least 2 checkpoints from the top block
-                    nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), mint.GetDenomination());
-                    if(nMintsAdded >= Params().Zerocoin_RequiredAccumulation())
-                        break;
-                    pindex = chainActive[pindex->nHeight + 1];
-                }
-
-                if(nMintsAdded < Params().Zerocoin_RequiredAccumulation())
-                    continue;
-            }
-        }
-        listPubCoin.emplace_back(mint);
-    }
-
-    pcursor->close();
-
-    //overwrite any updates
-    for (CZerocoinMint mint : vOverWrite) {
-        if(!this->WriteZerocoinMint(mint))
-            LogPrintf("%s failed to update mint from tx %s\n", __func__, mint.GetTxHash().GetHex());
-    }
-
-    // archive mints
-    for (CZerocoinMint mint : vArchive) {
-        if (!this->ArchiveMintOrphan(mint))
-            LogPrintf("%s failed to archive mint from %s\n", __func__, mint.GetTxHash().GetHex());
-    }
-
-    return listPubCoin;
-}
-// Just get the Serial Numbers
-std::list<CBigNum> CWalletDB::ListMintedCoinsSerial()
-{
-    std::list<CBigNum> listPubCoin;
-    std::list<CZerocoinMint> listCoins = ListMintedCoins(true, false, false);
-    
-    for ( auto& coin : listCoins) {
-        listPubCoin.push_back(coin.GetSerialNumber());
-    }
-    return listPubCoin;
-}
-
-
 std::list<CZerocoinSpend> CWalletDB::ListSpentCoins()
 {
     std::list<CZerocoinSpend> listCoinSpend;
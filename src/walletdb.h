@@ -16,6 +16,7 @@
 #include "libzerocoin/Accumulator.h"
 #include "libzerocoin/Denominations.h"
 
+#include <atomic>
 #include <list>
 #include <stdint.h>
 #include <string>
@@ -32,9 +33,13 @@ class CWallet;
 class CWalletTx;
 class CZerocoinMint;
 class CZerocoinSpend;
+class CZerocoinWitness;
 class uint160;
 class uint256;
 
+/** Bumped on every write to the zerocoin mints and spends, so balances counted from them know when to recount */
+extern std::atomic<unsigned int> nZerocoinDBUpdated;
+
 /** Error statuses for the wallet database */
 enum DBErrors {
     DB_LOAD_OK,
@@ -155,11 +160,12 @@ public:
     bool WriteZerocoinMint(const CZerocoinMint& zerocoinMint);
     bool EraseZerocoinMint(const CZerocoinMint& zerocoinMint);
     bool ReadZerocoinMint(const CBigNum &bnSerial, CZerocoinMint& zerocoinMint);
+    bool WriteZerocoinWitness(const CZerocoinWitness& witness);
+    bool ReadZerocoinWitness(const CBigNum& bnPubCoinValue, CZerocoinWitness& witness);
+    bool EraseZerocoinWitness(const CBigNum& bnPubCoinValue);
     bool ArchiveMintOrphan(const CZerocoinMint& zerocoinMint);
     bool UnarchiveZerocoin(const CZerocoinMint& mint);
-    std::list<CZerocoinMint> ListMintedCoins(bool fUnusedOnly, bool fMaturedOnly, bool fUpdateStatus);
     std::list<CZerocoinSpend> ListSpentCoins();
-    std::list<CBigNum> ListMintedCoinsSerial();
     std::list<CBigNum> ListSpentCoinsSerial();
     std::list<CZerocoinMint> ListArchivedZerocoins();
     bool WriteZerocoinSpendSerialEntry(const CZerocoinSpend& zerocoinSpend);
@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zerocoinspendcache.h"
+
+#include "hash.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+namespace {
+
+class CZerocoinSpendCache
+{
+private:
+    //! hash of (serialized spend, accumulator value)
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_spendcache;
+
+public:
+    bool Get(const uint256& hash)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        return setValid.count(hash) > 0;
+    }
+
+    void Set(const uint256& hash)
+    {
+        // A verified spend costs ~32 bytes here against ~20KB of proof, and
+        // the memory pool rarely holds more than a few hundred of them
+        int64_t nMaxCacheSize = GetArg("-maxzerocoinspendcachesize", 10000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        {
+            // Evict a random entry, as the signature cache does
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(hash);
+    }
+};
+
+CZerocoinSpendCache spendCache;
+
+uint256 GetSpendCacheHash(const libzerocoin::CoinSpend& spend, const CBigNum& bnAccumulatorValue)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << spend << bnAccumulatorValue;
+    return ss.GetHash();
+}
+
+}
+
+bool IsZerocoinSpendVerified(const libzerocoin::CoinSpend& spend, const CBigNum& bnAccumulatorValue)
+{
+    return spendCache.Get(GetSpendCacheHash(spend, bnAccumulatorValue));
+}
+
+void SetZerocoinSpendVerified(const libzerocoin::CoinSpend& spend, const CBigNum& bnAccumulatorValue)
+{
+    spendCache.Set(GetSpendCacheHash(spend, bnAccumulatorValue));
+}
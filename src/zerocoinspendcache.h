@@ -0,0 +1,21 @@
+// Copyright (c) 2018 The Wagerr developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WAGERR_ZEROCOINSPENDCACHE_H
+#define WAGERR_ZEROCOINSPENDCACHE_H
+
+#include "libzerocoin/CoinSpend.h"
+
+/**
+ * Valid zerocoin spend cache, to avoid verifying the spend proofs twice for
+ * every zerocoin spend (once when accepted into the memory pool, and again
+ * when the block holding it is checked).
+ * Entries are keyed by the whole serialized spend (serial, accumulator
+ * checksum, txout hash and the proofs themselves) together with the
+ * accumulator value it was verified against.
+ */
+bool IsZerocoinSpendVerified(const libzerocoin::CoinSpend& spend, const CBigNum& bnAccumulatorValue);
+void SetZerocoinSpendVerified(const libzerocoin::CoinSpend& spend, const CBigNum& bnAccumulatorValue);
+
+#endif // WAGERR_ZEROCOINSPENDCACHE_H